@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "Body.hpp"
+#include "Transform.hpp"
+
+struct Keyframe{
+    double time;
+    Vec_3d offset;
+    Vec_3d rot_vec;
+};
+
+struct Camera_keyframe{
+    double time;
+    Vec_3d pos, targ;
+};
+
+// Keyframes are kept sorted by time; values are linearly interpolated
+// and held constant outside of the keyed range.
+class Track{
+private:
+
+public:
+    std::vector<Keyframe> keys;
+
+    void add(Keyframe key);
+    Transform at(double time) const;
+};
+
+class Camera_track{
+private:
+
+public:
+    std::vector<Camera_keyframe> keys;
+
+    void add(Camera_keyframe key);
+    Camera_keyframe at(double time) const;
+};
+
+class Animation{
+private:
+
+public:
+    std::vector< std::pair<Body *, Track> > bodies;
+    Camera_track camera;
+
+    // Moves the animated bodies; returns whether anything moved.
+    bool apply(double time);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for scene nodes: objects are placed contiguously in large
+// blocks and all destroyed at once, in reverse order, with the arena.
+class Arena{
+private:
+    struct Destructor{
+        void (*destroy)(void *);
+        void *obj;
+    };
+
+    std::vector< std::unique_ptr<char[]> > blocks;
+    std::vector<Destructor> destructors;
+    size_t block_size;
+    char *curr;
+    size_t left;
+
+public:
+    Arena(size_t block_size = 1 << 16): block_size(block_size), curr(nullptr), left(0) {};
+
+    ~Arena(){
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it){
+            it->destroy(it->obj);
+        }
+    };
+
+    Arena(Arena const &) = delete;
+    Arena& operator=(Arena const &) = delete;
+
+    void *allocate(size_t size, size_t align){
+        void *ptr = curr;
+        if (!curr || !std::align(align, size, ptr, left)){
+            size_t amm = std::max(block_size, size + align);
+            blocks.push_back(std::make_unique<char[]>(amm));
+            ptr = blocks.back().get();
+            left = amm;
+            std::align(align, size, ptr, left);
+        }
+        curr = static_cast<char *>(ptr) + size;
+        left -= size;
+        return ptr;
+    };
+
+    template <class T, class... Args>
+    T *make(Args&&... args){
+        T *obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value){
+            destructors.push_back(Destructor{[](void *ptr){ static_cast<T *>(ptr)->~T(); }, obj});
+        }
+        return obj;
+    };
+};
@@ -2,40 +2,75 @@
 
 #include "Material.hpp"
 #include "Shape.hpp"
+#include "Transform.hpp"
 
 #include <algorithm>
 
+// Shape and material are not owned: scene nodes live in an Arena.
 class Body{
 private:
+    Intersection_point closest_hit(Photon const &photon, Hit_buffer &hits){
+        hits.clear();
+        shape->get_intersections(photon, hits);
+
+        std::sort(hits.begin(), hits.end());
+
+        for (auto hit : hits){
+            Vec_3d pos = photon.pos + hit.dist * photon.dir;
+            if(shape->point_is_inside(pos, hit.shape)){
+                return Intersection_point(pos, hit.shape, hit.dist);
+            }
+        }
+        return Intersection_point();
+    };
 
 public:
     Shape_base *shape;
     Material *material;
     std::string name;
 
-    std::vector< Intersection_point > intersections;
-
-    Body(Shape_base *shape, Material *material, std::string name): shape(shape), material(material), name(name) {};
+    // Placement of the shape in the world and the world-space bounds it gives.
+    Transform transform;
+    Aabb bounds;
+    size_t max_hits;
+    // Dense index of the material among those of the scene, set by Bvh
+    size_t material_ind;
 
-    ~Body(){
-        delete shape;
-        delete material;
+    Body(Shape_base *shape, Material *material, std::string name): shape(shape), material(material), name(name), material_ind(0) {
+        max_hits = shape->max_hits();
+        update_bounds();
     };
 
-    Intersection_point get_intersection(Photon photon){
-        intersections.clear();
-        shape->get_intersections(photon, intersections);
+    void set_transform(Transform const &tr){
+        transform = tr;
+        update_bounds();
+    };
+    void update_bounds(){
+        bounds = shape->get_bounds().transformed(transform);
+    };
 
-        std::sort(intersections.begin(), intersections.end());
+    // hits is scratch space with room for max_hits entries
+    Intersection_point get_intersection(Photon const &photon, Hit_buffer &hits){
+        if (transform.identity){
+            return closest_hit(photon, hits);
+        }
 
-        for (auto inter : intersections){
-            if(shape->point_is_inside(inter)){
-                return inter;
-            }
+        Photon local(photon);
+        local.pos = transform.apply_inv(photon.pos);
+        local.dir = transform.rotate_inv(photon.dir);
+        Intersection_point inter = closest_hit(local, hits);
+        if (inter.shape){
+            inter.pos = transform.apply(inter.pos);
         }
-        return Intersection_point();
+        return inter;
+    };
+    Vec_3d get_normal(Intersection_point const &inter){
+        if (transform.identity){
+            return inter.shape->get_normal(inter.pos);
+        }
+        return transform.rotate(inter.shape->get_normal(transform.apply_inv(inter.pos)));
     };
-    void interact(Photon &photon, Vec_3d normal){
+    void interact(Photon &photon, Vec_3d const &normal){
         material->interact(photon, normal);
     };
 };
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Body.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Median split shared by the tree builders: items [begin, end) are
+// partitioned at the returned middle along the longest axis of their joint
+// box, which is written to box.
+template <class Item, class Get_box>
+size_t median_split(std::vector<Item> &items, size_t begin, size_t end, Get_box get_box, Aabb &box){
+    box = get_box(items[begin]);
+    for (size_t i=begin+1; i<end; ++i){
+        box = box.merge(get_box(items[i]));
+    }
+    Vec_3d extent = box.hi - box.lo;
+    int axis = 0;
+    if (extent.y > extent[axis]) {axis = 1;}
+    if (extent.z > extent[axis]) {axis = 2;}
+
+    size_t mid = (begin + end) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+        [axis, &get_box](Item const &lha, Item const &rha){
+            return get_box(lha).center()[axis] < get_box(rha).center()[axis];
+        });
+    return mid;
+}
+
+// Bounding volume hierarchy over the bodies of a scene. Bodies with unbounded
+// shapes (planes, inversions) are kept aside and tested on every query.
+// The tree topology is built once; refit() only recomputes the boxes, so
+// moving bodies between frames does not need a rebuild.
+// The distinct materials of the scene are numbered as well, see Body::material_ind.
+class Bvh{
+private:
+    struct Node{
+        Aabb box;
+        int left, right;
+        Body *body;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Body *> unbounded;
+    std::vector<Material *> materials;
+    // Largest Body::max_hits in the scene
+    size_t hit_capacity;
+
+    Body *get_intersection(Photon const &photon, Intersection_point &closest_inter, Hit_buffer &hits);
+
+    int build(std::vector<Body *> &bodies, size_t begin, size_t end);
+    Aabb refit(int node);
+
+public:
+    // Hit lists up to this size live on the stack
+    static const size_t inline_hits = 32;
+
+    Bvh(std::vector<Body *> const &scene);
+
+    void refit();
+    Body *get_intersection(Photon const &photon, Intersection_point &closest_inter);
+    // Indexed by Body::material_ind
+    std::vector<Material *> const &get_materials() const{
+        return materials;
+    };
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <utility>
+
+#include "Arena.hpp"
+#include "Shape.hpp"
+
+// Compile-time CSG: the expression tree is encoded in the type, e.g.
+//     auto shape = intersect(cube, invert(csg_ball(Vec_3d(-2, 2, 12), 2)));
+// so intersection and inside tests inline into one function with no virtual
+// calls or pointer chasing. Shape_static wraps an expression as a Shape_base
+// for use with Body and the runtime CSG nodes.
+//
+// Every node provides:
+//     leaves                                   number of primitives below it
+//     intersections(photon, emit, first)       emit(dist, leaf) for each surface crossing
+//     inside(pos, leaf, first)                 leaf is the primitive pos lies on, or -1
+//     nearest_surface(pos, dist, normal)       normal of the closest primitive surface
+//     bounds()
+// Primitives are numbered depth-first starting at first.
+
+class Csg_plane{
+private:
+
+public:
+    static const int leaves = 1;
+
+    Vec_3d pos, normal;
+
+    Csg_plane(Vec_3d pos, Vec_3d normal): pos(pos), normal(normal/normal.len()) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        double dist = - (((photon.pos - pos) * normal) / (photon.dir * normal));
+        if (dist > 0){
+            emit(dist, first);
+        }
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        return leaf == first || (point - pos) * normal < 0;
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        double d = std::abs((point - pos) * normal);
+        if (d < dist){
+            dist = d;
+            surf_normal = normal;
+        }
+    };
+    Aabb bounds() const{
+        return Shape_plane(pos, normal).get_bounds();
+    };
+};
+
+class Csg_ball{
+private:
+
+public:
+    static const int leaves = 1;
+
+    Vec_3d pos;
+    double rad;
+
+    Csg_ball(Vec_3d pos, double rad): pos(pos), rad(rad) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        Vec_3d pos_rel = photon.pos - pos;
+        double pos_dot_dir = pos_rel * photon.dir;
+        double discriminant = sqr(pos_dot_dir) - pos_rel.sqr() + sqr(rad);
+        if (discriminant < 0){
+            return;
+        }
+        double root = std::sqrt(discriminant);
+        if (-pos_dot_dir - root > 0) {emit(-pos_dot_dir - root, first);}
+        if (-pos_dot_dir + root > 0) {emit(-pos_dot_dir + root, first);}
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        return leaf == first || (point - pos).sqr() < sqr(rad);
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        Vec_3d point_rel = point - pos;
+        double len = point_rel.len();
+        double d = std::abs(len - rad);
+        if (d < dist && len > 0){
+            dist = d;
+            surf_normal = point_rel / len;
+        }
+    };
+    Aabb bounds() const{
+        return Aabb(pos - Vec_3d(rad, rad, rad), pos + Vec_3d(rad, rad, rad));
+    };
+};
+
+class Csg_cylinder{
+private:
+
+public:
+    static const int leaves = 1;
+
+    Vec_3d pos, dir;
+    double rad;
+
+    Csg_cylinder(Vec_3d pos, Vec_3d dir, double rad): pos(pos), dir(dir/dir.len()), rad(rad) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        Vec_3d pos_rel = photon.pos - pos;
+        Vec_3d pos_radial = pos_rel    - (pos_rel    * dir) * dir;
+        Vec_3d dir_radial = photon.dir - (photon.dir * dir) * dir;
+
+        double scalar_radial = pos_radial * dir_radial;
+        double discriminant = sqr(scalar_radial) - (pos_radial.sqr() - sqr(rad)) * dir_radial.sqr();
+        if (discriminant < 0){
+            return;
+        }
+        double root = std::sqrt(discriminant);
+        double inv = 1 / dir_radial.sqr();
+        if ((-scalar_radial - root) * inv > 0) {emit((-scalar_radial - root) * inv, first);}
+        if ((-scalar_radial + root) * inv > 0) {emit((-scalar_radial + root) * inv, first);}
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        Vec_3d pos_rel = point - pos;
+        return leaf == first || pos_rel.sqr() - sqr(pos_rel * dir) < sqr(rad);
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        Vec_3d point_rel = point - pos;
+        Vec_3d radial = point_rel - (point_rel * dir) * dir;
+        double len = radial.len();
+        double d = std::abs(len - rad);
+        if (d < dist && len > 0){
+            dist = d;
+            surf_normal = radial / len;
+        }
+    };
+    Aabb bounds() const{
+        return Shape_cylinder(pos, dir, rad).get_bounds();
+    };
+};
+
+template <class A>
+class Csg_inversion{
+private:
+
+public:
+    static const int leaves = A::leaves;
+
+    A a;
+
+    Csg_inversion(A a): a(a) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        a.intersections(photon, emit, first);
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        return !a.inside(point, leaf, first);
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        a.nearest_surface(point, dist, surf_normal);
+    };
+    Aabb bounds() const{
+        return Aabb::infinite();
+    };
+};
+
+template <class A, class B>
+class Csg_union{
+private:
+
+public:
+    static const int leaves = A::leaves + B::leaves;
+
+    A a;
+    B b;
+
+    Csg_union(A a, B b): a(a), b(b) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        a.intersections(photon, emit, first);
+        b.intersections(photon, emit, first + A::leaves);
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        return a.inside(point, leaf, first) || b.inside(point, leaf, first + A::leaves);
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        a.nearest_surface(point, dist, surf_normal);
+        b.nearest_surface(point, dist, surf_normal);
+    };
+    Aabb bounds() const{
+        return a.bounds().merge(b.bounds());
+    };
+};
+
+template <class A, class B>
+class Csg_intersection{
+private:
+
+public:
+    static const int leaves = A::leaves + B::leaves;
+
+    A a;
+    B b;
+
+    Csg_intersection(A a, B b): a(a), b(b) {};
+
+    template <class Emit>
+    void intersections(Photon const &photon, Emit &&emit, int first) const{
+        a.intersections(photon, emit, first);
+        b.intersections(photon, emit, first + A::leaves);
+    };
+    bool inside(Vec_3d const &point, int leaf, int first) const{
+        return a.inside(point, leaf, first) && b.inside(point, leaf, first + A::leaves);
+    };
+    void nearest_surface(Vec_3d const &point, double &dist, Vec_3d &surf_normal) const{
+        a.nearest_surface(point, dist, surf_normal);
+        b.nearest_surface(point, dist, surf_normal);
+    };
+    Aabb bounds() const{
+        return a.bounds().overlap(b.bounds());
+    };
+};
+
+inline Csg_plane csg_plane(Vec_3d pos, Vec_3d normal){
+    return Csg_plane(pos, normal);
+}
+inline Csg_ball csg_ball(Vec_3d pos, double rad){
+    return Csg_ball(pos, rad);
+}
+inline Csg_cylinder csg_cylinder(Vec_3d pos, Vec_3d dir, double rad){
+    return Csg_cylinder(pos, dir, rad);
+}
+template <class A>
+Csg_inversion<A> invert(A a){
+    return Csg_inversion<A>(a);
+}
+template <class A, class B>
+Csg_union<A, B> unite(A a, B b){
+    return Csg_union<A, B>(a, b);
+}
+template <class A, class B>
+Csg_intersection<A, B> intersect(A a, B b){
+    return Csg_intersection<A, B>(a, b);
+}
+
+// Adapter to the runtime shapes. Only crossings that lie on the surface of
+// the whole expression are reported, all of them with shape == this.
+template <class Expr>
+class Shape_static: public Shape_base{
+private:
+
+public:
+    Expr expr;
+
+    Shape_static(Expr expr): expr(expr) {};
+
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
+        // each primitive is crossed at most twice
+        std::pair<double, int> hits[2 * Expr::leaves];
+        int hit_amm = 0;
+        expr.intersections(photon, [&](double dist, int leaf){
+            hits[hit_amm++] = std::make_pair(dist, leaf);
+        }, 0);
+
+        for (int i=0; i<hit_amm; ++i){
+            Vec_3d pos_inter = photon.pos + hits[i].first * photon.dir;
+            if (expr.inside(pos_inter, hits[i].second, 0)){
+                ans.push_back(Hit{hits[i].first, this});
+            }
+        }
+    };
+    Vec_3d get_normal(Vec_3d const &point){
+        double dist = std::numeric_limits<double>::infinity();
+        Vec_3d normal(1, 0, 0);
+        expr.nearest_surface(point, dist, normal);
+        return normal;
+    };
+    Aabb get_bounds(){
+        return expr.bounds();
+    };
+    size_t max_hits(){
+        return 2 * Expr::leaves;
+    };
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return this == surface || expr.inside(point, -1, 0);
+    };
+};
+
+template <class Expr>
+Shape_static<Expr> *make_static_shape(Arena &arena, Expr expr){
+    return arena.make< Shape_static<Expr> >(expr);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Render.hpp"
+
+struct Denoise_settings{
+    int radius;
+    double sigma_space;
+    // Colour difference is measured in units of the photon shot noise of the centre pixel
+    double sigma_color;
+    double sigma_normal;
+    // Relative depth difference
+    double sigma_depth;
+
+    size_t tile_size;
+    size_t thread_amm;
+};
+
+Denoise_settings default_denoise_settings();
+
+// Joint bilateral filter of the accumulated image guided by the auxiliary
+// buffers; pixels showing different bodies never mix. The image is split in
+// tiles that are filtered by thread_amm threads.
+void denoise(Pixel const *pixels, Aux_pixel const *aux, Pixel *out, size_t width, size_t height, Denoise_settings const &ds);
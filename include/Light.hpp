@@ -0,0 +1,192 @@
+#pragma once
+
+#include <vector>
+
+#include "Arena.hpp"
+#include "Body.hpp"
+#include "Bvh.hpp"
+#include "Sampling.hpp"
+
+// Emitter the photons of a frame start from. Photons come out with unit
+// weight; Light_sampler rescales them for how often the light is chosen.
+class Light_base{
+private:
+
+public:
+    virtual ~Light_base() = default;
+    // Radiant power, relative to the other lights of the scene
+    virtual double power() = 0;
+    // Region the photons start from
+    virtual Aabb get_bounds() = 0;
+    virtual Photon emit(Rng &rng) = 0;
+    // amm photons appended to ans
+    virtual void emit(Rng &rng, size_t amm, std::vector<Photon> &ans){
+        for (size_t i=0; i<amm; ++i){
+            ans.push_back(emit(rng));
+        }
+    };
+};
+
+// Isotropic point light
+class Light_point: public Light_base{
+private:
+
+public:
+    Vec_3d pos;
+    double flux;
+
+    Light_point(Vec_3d pos, double flux): pos(pos), flux(flux) {};
+
+    double power(){
+        return flux;
+    };
+    Aabb get_bounds(){
+        return Aabb(pos, pos);
+    };
+    Photon emit(Rng &rng){
+        double u_1 = rng.uniform();
+        return Photon(pos, sample_uniform_sphere(u_1, rng.uniform()));
+    };
+};
+
+// Spot light: uniform over the directions within theta_max of dir
+class Light_cone: public Light_base{
+private:
+    Onb onb;
+    double cos_max;
+
+public:
+    Vec_3d pos;
+    double flux;
+
+    Light_cone(Vec_3d pos, Vec_3d dir, double theta_max, double flux):
+        onb(dir / dir.len()), cos_max(std::cos(theta_max)), pos(pos), flux(flux) {};
+
+    double power(){
+        return flux;
+    };
+    Aabb get_bounds(){
+        return Aabb(pos, pos);
+    };
+    Photon emit(Rng &rng){
+        double u_1 = rng.uniform();
+        return Photon(pos, onb.to_world(sample_cone(u_1, rng.uniform(), cos_max)));
+    };
+    void emit(Rng &rng, size_t amm, std::vector<Photon> &ans);
+};
+
+// Area light over the surface of a body with an emissive material, with
+// cosine-weighted directions. The body is not owned and may move.
+class Light_body: public Light_base{
+private:
+
+public:
+    Body *body;
+
+    Light_body(Body *body): body(body) {};
+
+    double power(){
+        return body->material->emitted_power();
+    };
+    Aabb get_bounds(){
+        return body->bounds;
+    };
+    Photon emit(Rng &rng);
+};
+
+// Lights for the bodies of scene with an emissive material; bodies whose shape
+// has no surface to sample are reported and skipped.
+std::vector<Light_base *> emissive_lights(Arena &arena, std::vector<Body *> const &scene);
+
+// Binary tree over the lights, split like Bvh, with the summed power of
+// every subtree. A cluster stands in for its lights where they are far away
+// compared to their spread; each keeps an alias table to pick its lights by
+// power. Powers are read once, at construction.
+class Light_tree{
+private:
+    struct Node{
+        Aabb box;
+        double power;
+        int left, right;
+        // Range of the node in the leaf order of lights
+        size_t begin, end;
+    };
+
+    std::vector<Light_base *> lights;
+    std::vector<Node> nodes;
+    std::vector<Alias_table> tables;
+
+    int build(size_t begin, size_t end);
+    void refit(int node);
+    // Size of the cluster as seen from the viewer, 0 for single lights
+    double spread(int node, Vec_3d const &viewer) const;
+
+public:
+    Light_tree(std::vector<Light_base *> const &lights);
+
+    bool empty() const{
+        return nodes.empty();
+    };
+    double power(int node) const{
+        return nodes[node].power;
+    };
+    size_t light_amm(int node) const{
+        return nodes[node].end - nodes[node].begin;
+    };
+    // Recomputes the boxes, for lights attached to moving bodies
+    void refit();
+    // Clusters covering every light once: opened widest first while they look
+    // wider than max_spread (half diagonal over distance), up to cut_max of them
+    void cut(Vec_3d const &viewer, double max_spread, size_t cut_max, std::vector<int> &ans) const;
+    // Power over squared distance from the viewer
+    double importance(int node, Vec_3d const &viewer) const;
+    // Light of the cluster, chosen by power
+    Light_base *sample(int node, double u) const{
+        Node const &curr = nodes[node];
+        return lights[curr.begin + tables[node].sample(u)];
+    };
+};
+
+// Picks the light of every photon in O(1): an alias table over the clusters
+// of a cut through the light tree, then the one of the cluster. Part of the
+// photons is spread by power alone and the rest by importance for the region
+// the camera looks at; photon weights undo the choice, so the image stays
+// unbiased wherever the focus is.
+class Light_sampler{
+private:
+    Light_tree tree;
+    std::vector<int> clusters;
+    Alias_table table;
+    // Factor on the weights of photons from each cluster
+    std::vector<double> weight;
+
+public:
+    // Fraction of the photons given out by power alone
+    double power_share;
+    // Cut parameters, see Light_tree::cut
+    double max_spread;
+    size_t cut_max;
+
+    Light_sampler(std::vector<Light_base *> const &lights, double power_share = 0.25, double max_spread = 0.5, size_t cut_max = 64);
+
+    bool empty() const{
+        return tree.empty();
+    };
+    // For lights attached to bodies that moved
+    void refit(){
+        tree.refit();
+    };
+    // Aims the sampler at viewer, e.g. the camera target; costs O(cut_max),
+    // whatever the number of lights
+    void focus(Vec_3d const &viewer);
+
+    Photon emit(Rng &rng){
+        size_t k = table.sample(rng.uniform());
+        Photon photon = tree.sample(clusters[k], rng.uniform())->emit(rng);
+        photon.wl.scale(weight[k]);
+        return photon;
+    };
+    // amm photons appended to ans; single lights of the cut emit theirs as one batch.
+    // Safe to call from several threads at once, between calls to focus.
+    void emit(Rng &rng, size_t amm, std::vector<Photon> &ans);
+};
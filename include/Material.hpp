@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Sampling.hpp"
 #include "Vec_3d.hpp"
 
 
@@ -8,14 +9,25 @@ private:
 
 public:
     virtual ~Material() = default;
-    virtual void interact(Photon &photon, Vec_3d normal) = 0;
+    virtual void interact(Photon &photon, Vec_3d const &normal) = 0;
+    // Deterministic (mirror-like or see-through) interaction
+    virtual bool is_specular(){
+        return false;
+    };
+    // Radiant power given off by a body of this material, see Light_body
+    virtual double emitted_power(){
+        return 0.0;
+    };
 };
 
 class Transparent: public Material{
 private:
 
 public:
-    void interact(Photon &photon, Vec_3d normal){
+    bool is_specular(){
+        return true;
+    };
+    void interact(Photon &photon, Vec_3d const &normal){
 
     };
 };
@@ -24,26 +36,36 @@ class Absorbing: public Material{
 private:
 
 public:
-    void interact(Photon &photon, Vec_3d normal){
+    void interact(Photon &photon, Vec_3d const &normal){
         photon.alive = false;
     };
 };
 
-class Lambertian: public Material{
+// Light source surface: emits power in total and absorbs the photons that reach it.
+class Emissive: public Material{
 private:
 
 public:
-    void interact(Photon &photon, Vec_3d normal){
-        double phi = rand_uns(0, 4*std::acos(0));
-        double cos_phi = std::cos(phi);
-        double sin_phi = std::sin(phi);
+    double power;
+
+    Emissive(double power): power(power) {};
+
+    double emitted_power(){
+        return power;
+    };
+    void interact(Photon &photon, Vec_3d const &normal){
+        photon.alive = false;
+    };
+};
 
-        double theta = std::acos(std::sqrt(rand_uns(0, 1)));
-        double cos_theta = std::cos(theta);
-        double sin_theta = std::sin(theta);
+class Lambertian: public Material{
+private:
 
-        Vec_3d deviation(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
-        Vec_3d new_dir = rotate_a_to_b(Vec_3d(0, 0, 1), normal, deviation);
+public:
+    void interact(Photon &photon, Vec_3d const &normal){
+        Rng &rng = thread_rng();
+        double u_1 = rng.uniform();
+        Vec_3d new_dir = Onb(normal).to_world(sample_cosine(u_1, rng.uniform()));
 
         if ( (new_dir * normal) * (photon.dir * normal) > 0 ){
             new_dir = -new_dir;
@@ -60,17 +82,10 @@ public:
 
     Lambertian_cos(double pow_index):pow_index(pow_index) {};
 
-    void interact(Photon &photon, Vec_3d normal){
-        double phi = rand_uns(0, 4*std::acos(0));
-        double cos_phi = std::cos(phi);
-        double sin_phi = std::sin(phi);
-
-        double theta = std::acos(std::pow(rand_uns(0, 1), 1/(2+pow_index)));
-        double cos_theta = std::cos(theta);
-        double sin_theta = std::sin(theta);
-
-        Vec_3d deviation(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
-        Vec_3d new_dir = rotate_a_to_b(Vec_3d(0, 0, 1), normal, deviation);
+    void interact(Photon &photon, Vec_3d const &normal){
+        Rng &rng = thread_rng();
+        double u_1 = rng.uniform();
+        Vec_3d new_dir = Onb(normal).to_world(sample_cos_power(u_1, rng.uniform(), pow_index));
 
         if ( (new_dir * normal) * (photon.dir * normal) > 0 ){
             new_dir = -new_dir;
@@ -83,20 +98,107 @@ class Reflecting: public Material{
 private:
 
 public:
-    void interact(Photon &photon, Vec_3d normal){
+    bool is_specular(){
+        return true;
+    };
+    void interact(Photon &photon, Vec_3d const &normal){
         photon.dir -= 2*(photon.dir*normal) * normal;
     };
 };
 
+class Dispersion_base{
+private:
+
+public:
+    virtual ~Dispersion_base() = default;
+    virtual double refr_ind(double lambda) = 0;
+    virtual bool is_dispersive() = 0;
+};
+
+class Dispersion_constant: public Dispersion_base{
+private:
+
+public:
+    double n;
+
+    Dispersion_constant(double n): n(n) {};
+
+    double refr_ind(double lambda){
+        return n;
+    };
+    bool is_dispersive(){
+        return false;
+    };
+};
+
+// n = A + B/lambda^2 + C/lambda^4, lambda in micrometers
+class Dispersion_cauchy: public Dispersion_base{
+private:
+
+public:
+    double a, b, c;
+
+    Dispersion_cauchy(double a, double b, double c = 0): a(a), b(b), c(c) {};
+
+    double refr_ind(double lambda){
+        double l_sqr = sqr(lambda * 1E-3);
+        return a + b / l_sqr + c / sqr(l_sqr);
+    };
+    bool is_dispersive(){
+        return b != 0 || c != 0;
+    };
+};
+
+// n^2 = 1 + sum B_i lambda^2 / (lambda^2 - C_i), lambda in micrometers
+class Dispersion_sellmeier: public Dispersion_base{
+private:
+
+public:
+    double b[3], c[3];
+
+    Dispersion_sellmeier(double b_1, double b_2, double b_3, double c_1, double c_2, double c_3):
+        b{b_1, b_2, b_3}, c{c_1, c_2, c_3} {};
+
+    double refr_ind(double lambda){
+        double l_sqr = sqr(lambda * 1E-3);
+        double n_sqr = 1;
+        for (int i=0; i<3; ++i){
+            n_sqr += b[i] * l_sqr / (l_sqr - c[i]);
+        }
+        return std::sqrt(n_sqr);
+    };
+    bool is_dispersive(){
+        return true;
+    };
+};
+
+// The dispersion model is not owned; a constant index is kept inline.
 class Refracting: public Material{
 private:
+    Dispersion_constant constant;
 
 public:
-    double refr_ind;
+    Dispersion_base *dispersion;
+
+    Refracting(double refr_ind): constant(refr_ind), dispersion(&constant) {};
+    Refracting(Dispersion_base *dispersion): constant(1), dispersion(dispersion) {};
+
+    Refracting(Refracting const &) = delete;
+    Refracting& operator=(Refracting const &) = delete;
+    bool is_specular(){
+        return true;
+    };
+
+    void interact(Photon &photon, Vec_3d const &surf_normal){
+        Vec_3d normal = surf_normal;
 
-    Refracting(double refr_ind): refr_ind(refr_ind){};
+        // The direction is chosen by the hero wavelength; the companions
+        // would refract elsewhere, so they are dropped from the bundle.
+        double refr_ind = dispersion->refr_ind(photon.wl.lambda[0]);
+        if (dispersion->is_dispersive() && !photon.wl.secondary_terminated()){
+            photon.wl.terminate_secondary();
+        }
 
-    void interact(Photon &photon, Vec_3d normal){
         double rel_refr_ind = refr_ind;
         if (photon.dir * normal > 0) {
             rel_refr_ind = 1.0/refr_ind;
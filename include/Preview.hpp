@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Render.hpp"
+
+// Layout of the shared-memory segment: the header is followed by
+// width*height*3 floats of linear RGB, rows top to bottom.
+// sequence is odd while the image is being updated (seqlock).
+// owner_pid is the process writing the segment.
+struct Preview_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t data_offset;
+    int64_t owner_pid;
+    std::atomic<uint64_t> sequence;
+    uint64_t photon_count;
+    uint64_t hit_count;
+    uint64_t frame;
+};
+
+const char preview_magic[8] = "RAYPRV";
+const uint32_t preview_version = 2;
+
+// Publishes snapshots of the accumulation buffer through a named POSIX
+// shared-memory segment, e.g. "/ray_1" shows up as /dev/shm/ray_1.
+// The segment is created exclusively. A segment left by a process that is no
+// longer running is taken over; if a live one holds the name, is_open() is false.
+class Preview{
+private:
+    std::string name;
+    size_t width, height;
+    size_t size;
+    void *mem;
+    Preview_header *header;
+    float *data;
+
+public:
+    Preview(std::string name, size_t width, size_t height);
+    ~Preview();
+
+    Preview(Preview const &) = delete;
+    Preview& operator=(Preview const &) = delete;
+
+    bool is_open() const{
+        return mem != nullptr;
+    };
+    void publish(Pixel const *pixels, size_t photon_count, size_t hit_count, size_t frame);
+};
+
+// Maps an existing preview segment read-only and takes consistent snapshots of it.
+class Preview_reader{
+private:
+    size_t size;
+    void *mem;
+    Preview_header const *header;
+
+public:
+    Preview_reader(std::string name);
+    ~Preview_reader();
+
+    Preview_reader(Preview_reader const &) = delete;
+    Preview_reader& operator=(Preview_reader const &) = delete;
+
+    bool is_open() const{
+        return mem != nullptr;
+    };
+    size_t width() const{
+        return header->width;
+    };
+    size_t height() const{
+        return header->height;
+    };
+    // Copies the image into rgb (width*height*3 floats) along with the sequence number of the copy.
+    // False if no consistent copy could be taken within timeout seconds.
+    bool snapshot(float *rgb, uint64_t &photon_count, uint64_t &frame, uint64_t &sequence, double timeout = 2.0) const;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Render.hpp"
+
+// Binary path log, little endian, integers as LEB128 varints:
+//     "RAYPATH" '\0', u32 version
+//     body_amm, {name_len, name, material}  material_amm, {name_len, name}
+//     records until end of file:
+//         frame, photon, flags (1: path ran out of max_itr), vertex_amm,
+//         vertex_amm x {u8 kind, body + 1 (0: none), zigzag dx, dy, dz}
+// kind is 0 for the emission vertex, 1 + Photon_event otherwise. Positions are
+// quantized to 1/path_log_scale and stored as differences to the previous vertex.
+// photon counts from 1 within every frame of a sequence.
+
+const char path_log_magic[8] = "RAYPATH";
+const uint32_t path_log_version = 2;
+const double path_log_scale = 1024.0;
+
+struct Recorded_vertex{
+    Vec_3d pos;
+    uint8_t kind;
+    Body *body;
+};
+
+struct Recorded_path{
+    size_t frame;
+    size_t photon;
+    bool exhausted;
+    std::vector<Recorded_vertex> vertices;
+
+    void begin(size_t frame_ind, size_t photon_ind, Vec_3d pos){
+        frame = frame_ind;
+        photon = photon_ind;
+        exhausted = false;
+        vertices.clear();
+        vertices.push_back(Recorded_vertex{pos, 0, nullptr});
+    };
+    void add(Vec_3d pos, Photon_event event, Body *body){
+        vertices.push_back(Recorded_vertex{pos, uint8_t(1 + int(event)), body});
+    };
+};
+
+// Records every sample_period-th photon path. Tracing threads encode their
+// paths into their own single-producer ring; a background thread drains the
+// rings into the file. A full ring drops the path rather than stall a tracer.
+// A thread hands its ring back when it exits, so tracing threads started anew
+// every frame reuse the rings of the previous ones.
+class Path_recorder{
+private:
+    struct Ring{
+        std::vector<uint8_t> data;
+        std::atomic<size_t> head, tail;
+        // Set while a thread produces into the ring
+        std::atomic<bool> taken;
+
+        Ring(size_t capacity): data(capacity), head(0), tail(0), taken(true) {};
+    };
+
+    // Per thread hold on a ring; shared so that a thread outliving the
+    // recorder can still let go of it
+    struct Ring_lease{
+        size_t owner = size_t(-1);
+        std::shared_ptr<Ring> ring;
+
+        void release(){
+            if (ring){
+                ring->taken.store(false, std::memory_order_release);
+                ring.reset();
+            }
+            owner = size_t(-1);
+        };
+        ~Ring_lease(){
+            release();
+        };
+    };
+
+    size_t id;
+    size_t sample_period;
+    size_t ring_capacity;
+    std::unordered_map<Body *, size_t> body_id;
+    std::vector<std::string> body_names;
+    std::vector<size_t> body_material;
+    std::vector<std::string> material_names;
+
+    std::ofstream out;
+    std::mutex rings_mutex;
+    std::vector< std::shared_ptr<Ring> > rings;
+    std::atomic<bool> stop;
+    std::atomic<size_t> dropped;
+    std::thread writer;
+
+    Ring *ring();
+    bool drain();
+    void write_loop();
+
+public:
+    Path_recorder(std::string name, std::vector<Body *> const &scene, size_t sample_period, size_t ring_capacity = 1 << 20);
+    ~Path_recorder();
+
+    Path_recorder(Path_recorder const &) = delete;
+    Path_recorder& operator=(Path_recorder const &) = delete;
+
+    bool sample(size_t photon) const{
+        return photon % sample_period == 0;
+    };
+    void submit(Recorded_path const &path);
+    size_t dropped_amm() const{
+        return dropped;
+    };
+};
+
+void put_varint(std::vector<uint8_t> &buf, uint64_t val);
+uint64_t zigzag(int64_t val);
+int64_t unzigzag(uint64_t val);
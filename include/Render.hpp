@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+
+#include "Bvh.hpp"
+#include "Shape.hpp"
+
+class Light_sampler;
+class Preview;
+class Path_recorder;
+
+struct Pixel{
+    double r, g, b;
+
+    void add(Vec_3d rgb){
+        r += rgb.x;
+        g += rgb.y;
+        b += rgb.z;
+    }
+};
+
+// The surface a screen hit shows: the last non-specular vertex of the path
+// and the distance travelled from it.
+struct Path_guide{
+    Vec_3d normal;
+    double depth;
+    Body *body;
+
+    Path_guide(): normal(), depth(0), body(nullptr) {};
+
+    void advance(double dist){
+        depth += dist;
+    };
+    void vertex(Body *hit_body, Vec_3d hit_normal){
+        if (!hit_body->material->is_specular()){
+            body = hit_body;
+            normal = hit_normal;
+            depth = 0;
+        }
+    };
+    void scatter(){
+        *this = Path_guide();
+    };
+};
+
+// Per-pixel auxiliary buffer used to guide the denoiser.
+struct Aux_pixel{
+    Vec_3d normal;
+    double depth;
+    size_t count;
+    Body *body;
+
+    void add(Path_guide const &guide){
+        Vec_3d n = guide.normal;
+        if (n * normal < 0){
+            n = -n;
+        }
+        normal += n;
+        depth += guide.depth;
+        ++count;
+        body = guide.body;
+    }
+};
+
+enum class Photon_event {stray, screen, object, fog};
+
+struct Render_settings{
+    bool fog_present;
+    double fog_coef;
+    size_t max_itr;
+    double eps;
+    size_t ray_amm;
+    size_t width, height;
+
+    // Trace with the wavefront engine on thread_amm threads, each keeping
+    // pool_size photons in flight; small enough pools stay in cache
+    bool wavefront;
+    size_t pool_size;
+    size_t thread_amm;
+
+    // Live preview to publish progress to (may be nullptr) and the frame number shown there
+    Preview *preview;
+    size_t frame;
+
+    // Path log of sampled photons (may be nullptr)
+    Path_recorder *recorder;
+};
+
+size_t pixel_index(Screen &screen, Vec_3d pos, size_t width, size_t height);
+void print_ppm(Pixel *pixels, int width, int height, std::string name);
+void print_progress(size_t i, size_t ray_amm, size_t hit_count, size_t *itr_counter, size_t max_itr);
+size_t render_frame(Render_settings const &settings, Bvh &bvh, Light_sampler &lights, Screen screen, Pixel *pixels, Aux_pixel *aux, size_t *itr_counter);
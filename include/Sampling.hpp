@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Vec_3d.hpp"
+
+// xoshiro256** generator; one instance per thread through thread_rng().
+class Rng{
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k){
+        return (x << k) | (x >> (64 - k));
+    };
+
+public:
+    Rng(uint64_t seed);
+
+    uint64_t next(){
+        uint64_t ans = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return ans;
+    };
+    // uniform in [0, 1)
+    double uniform(){
+        return (next() >> 11) * 0x1.0p-53;
+    };
+};
+
+Rng &thread_rng();
+
+// sin and cos of 2*pi*u for u in [0, 1) without libm: the angle is reduced to
+// [-pi/4, pi/4] around a multiple of pi/2 and evaluated by Taylor polynomials
+// (error below 1E-11).
+inline void sincos_2pi(double u, double &s, double &c){
+    // int conversion rather than std::floor, which does not vectorize under default FP flags
+    int q = int(4*u + 0.5);
+    double x = (4*u - q) * 1.5707963267948966;
+    double x2 = x*x;
+    double sx = x * (1 + x2*(-1.0/6 + x2*(1.0/120 + x2*(-1.0/5040 + x2*(1.0/362880 + x2*(-1.0/39916800))))));
+    double cx = 1 + x2*(-0.5 + x2*(1.0/24 + x2*(-1.0/720 + x2*(1.0/40320 + x2*(-1.0/3628800 + x2*(1.0/479001600))))));
+
+    // quadrant selection done arithmetically to keep batch loops branch free
+    int quad = q & 3;
+    double odd = quad & 1;
+    double s_sel = sx + odd * (cx - sx);
+    double c_sel = cx + odd * (sx - cx);
+    s = s_sel * (1 - (quad & 2));
+    c = c_sel * (1 - ((quad + 1) & 2));
+}
+
+// Orthonormal basis around a unit vector n (Duff et al. 2017), without branches
+// or normalization. Local z maps to n.
+struct Onb{
+    Vec_3d t, b, n;
+
+    Onb(Vec_3d n): n(n) {
+        double sign = std::copysign(1.0, n.z);
+        double a = -1.0 / (sign + n.z);
+        double k = n.x * n.y * a;
+        t = Vec_3d(1 + sign * n.x * n.x * a, sign * k, -sign * n.x);
+        b = Vec_3d(k, sign + n.y * n.y * a, -n.y);
+    };
+
+    Vec_3d to_world(double x, double y, double z) const{
+        return Vec_3d(x*t.x + y*b.x + z*n.x, x*t.y + y*b.y + z*n.y, x*t.z + y*b.z + z*n.z);
+    };
+    Vec_3d to_world(Vec_3d const &v) const{
+        return to_world(v.x, v.y, v.z);
+    };
+};
+
+// Directions around +z from two uniforms in [0, 1); the azimuth comes from u_2.
+inline Vec_3d dir_from_cos(double cos_theta, double u_2){
+    double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta*cos_theta));
+    double s, c;
+    sincos_2pi(u_2, s, c);
+    return Vec_3d(sin_theta * c, sin_theta * s, cos_theta);
+}
+inline Vec_3d sample_uniform_sphere(double u_1, double u_2){
+    return dir_from_cos(1 - 2*u_1, u_2);
+}
+inline Vec_3d sample_cone(double u_1, double u_2, double cos_max){
+    return dir_from_cos(1 - u_1 * (1 - cos_max), u_2);
+}
+// pdf proportional to cos(theta)
+inline Vec_3d sample_cosine(double u_1, double u_2){
+    return dir_from_cos(std::sqrt(1 - u_1), u_2);
+}
+// pdf proportional to cos(theta)^(1 + pow_index)
+inline Vec_3d sample_cos_power(double u_1, double u_2, double pow_index){
+    return dir_from_cos(std::pow(1 - u_1, 1 / (2 + pow_index)), u_2);
+}
+
+// Structure-of-arrays buffer of directions.
+struct Dir_batch{
+    std::vector<double> x, y, z;
+
+    size_t size() const{
+        return x.size();
+    };
+    void resize(size_t amm){
+        x.resize(amm);
+        y.resize(amm);
+        z.resize(amm);
+    };
+    Vec_3d operator[](size_t i) const{
+        return Vec_3d(x[i], y[i], z[i]);
+    };
+};
+
+// Batch versions: amm directions written to ans, already turned into the frame of onb.
+void sample_uniform_sphere(Rng &rng, size_t amm, Dir_batch &ans);
+void sample_cone(Rng &rng, size_t amm, Onb const &onb, double cos_max, Dir_batch &ans);
+void sample_cosine(Rng &rng, size_t amm, Onb const &onb, Dir_batch &ans);
+void sample_cos_power(Rng &rng, size_t amm, Onb const &onb, double pow_index, Dir_batch &ans);
+
+// Discrete distribution over 0..n-1 sampled in O(1) with one uniform (Vose's alias method).
+class Alias_table{
+private:
+    std::vector<double> prob;
+    std::vector<size_t> alias;
+
+public:
+    Alias_table() {};
+    // weights need not be normalized, but must have a positive sum
+    Alias_table(std::vector<double> const &weights);
+
+    size_t size() const{
+        return prob.size();
+    };
+    size_t sample(double u) const{
+        double x = u * prob.size();
+        size_t i = std::min(size_t(x), prob.size() - 1);
+        return x - i < prob[i] ? i : alias[i];
+    };
+};
@@ -1,12 +1,16 @@
 #pragma once
 
+#include "Animation.hpp"
+#include "Arena.hpp"
 #include "Body.hpp"
+#include "Light.hpp"
 
-Shape_base *make_lens(Vec_3d pos, Vec_3d dir, double r_1, double r_2, double r_size);
-std::vector<Body *> init_scene_1();
-std::vector<Body *> init_scene_2();
-std::vector<Body *> init_scene_3();
-std::pair<Screen, Body *> make_camera(Vec_3d center, Vec_3d dir, double focus);
-
-Photon source(Vec_3d pos, double r);
-Photon cone_source (Vec_3d pos, Vec_3d dir, double theta_max);
+Shape_base *make_lens(Arena &arena, Vec_3d pos, Vec_3d dir, double r_1, double r_2, double r_size);
+std::vector<Body *> init_scene_1(Arena &arena);
+std::vector<Body *> init_scene_2(Arena &arena);
+std::vector<Body *> init_scene_3(Arena &arena);
+std::vector<Body *> init_scene_4(Arena &arena);
+std::vector<Light_base *> init_lights(Arena &arena, std::vector<Body *> const &scene);
+std::pair<Screen, Body *> make_camera(Arena &arena, Vec_3d center, Vec_3d dir, double focus);
+Transform camera_transform(Camera_keyframe const &ref, Camera_keyframe const &curr);
+Animation init_animation_3(std::vector<Body *> &scene, Camera_keyframe const &ref);
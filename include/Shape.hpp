@@ -1,11 +1,89 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
+#include "Sampling.hpp"
 #include "Vec_3d.hpp"
+#include "Transform.hpp"
 
 class Shape_base;
 
+// Axis-aligned box; unbounded sides are infinite, an empty box has lo > hi.
+struct Aabb{
+    Vec_3d lo, hi;
+
+    Aabb(Vec_3d lo, Vec_3d hi): lo(lo), hi(hi) {};
+    Aabb(): Aabb(Aabb::infinite()) {};
+
+    static Aabb infinite(){
+        double inf = std::numeric_limits<double>::infinity();
+        return Aabb(Vec_3d(-inf, -inf, -inf), Vec_3d(inf, inf, inf));
+    };
+    bool is_finite() const{
+        return std::isfinite(lo.x) && std::isfinite(lo.y) && std::isfinite(lo.z) &&
+               std::isfinite(hi.x) && std::isfinite(hi.y) && std::isfinite(hi.z);
+    };
+    Vec_3d center() const{
+        return (lo + hi) / 2;
+    };
+    Aabb merge(Aabb const &rha) const{
+        return Aabb(Vec_3d(std::min(lo.x, rha.lo.x), std::min(lo.y, rha.lo.y), std::min(lo.z, rha.lo.z)),
+                    Vec_3d(std::max(hi.x, rha.hi.x), std::max(hi.y, rha.hi.y), std::max(hi.z, rha.hi.z)));
+    };
+    Aabb overlap(Aabb const &rha) const{
+        return Aabb(Vec_3d(std::max(lo.x, rha.lo.x), std::max(lo.y, rha.lo.y), std::max(lo.z, rha.lo.z)),
+                    Vec_3d(std::min(hi.x, rha.hi.x), std::min(hi.y, rha.hi.y), std::min(hi.z, rha.hi.z)));
+    };
+    Aabb transformed(Transform const &tr) const{
+        if (tr.identity){
+            return *this;
+        }
+        if (tr.is_translation()){
+            return Aabb(lo + tr.offset, hi + tr.offset);
+        }
+        if (!is_finite()){
+            return Aabb::infinite();
+        }
+        Aabb ans(tr.apply(lo), tr.apply(lo));
+        for (int i=1; i<8; ++i){
+            Vec_3d corner(i&1 ? hi.x : lo.x, i&2 ? hi.y : lo.y, i&4 ? hi.z : lo.z);
+            Vec_3d p = tr.apply(corner);
+            ans = ans.merge(Aabb(p, p));
+        }
+        return ans;
+    };
+
+    // Entry distance of the ray into the box, infinity on a miss or beyond max_dist.
+    double hit_dist(Photon const &photon, double max_dist) const{
+        const double pad = 1E-9;
+        double t_min = 0, t_max = max_dist;
+        double p[3] = {photon.pos.x, photon.pos.y, photon.pos.z};
+        double d[3] = {photon.dir.x, photon.dir.y, photon.dir.z};
+        double l[3] = {lo.x - pad, lo.y - pad, lo.z - pad};
+        double h[3] = {hi.x + pad, hi.y + pad, hi.z + pad};
+        for (int i=0; i<3; ++i){
+            if (d[i] == 0){
+                if (p[i] < l[i] || p[i] > h[i]){
+                    return std::numeric_limits<double>::infinity();
+                }
+                continue;
+            }
+            double t_1 = (l[i] - p[i]) / d[i];
+            double t_2 = (h[i] - p[i]) / d[i];
+            if (t_1 > t_2) {std::swap(t_1, t_2);}
+            t_min = std::max(t_min, t_1);
+            t_max = std::min(t_max, t_2);
+            if (t_min > t_max){
+                return std::numeric_limits<double>::infinity();
+            }
+        }
+        return t_min;
+    };
+};
+
+// Closest hit of a body, with the position filled in.
 struct Intersection_point{
     Vec_3d pos;
     Shape_base *shape;
@@ -13,14 +91,53 @@ struct Intersection_point{
 
     Intersection_point(Vec_3d pos, Shape_base *shape, double dist): pos(pos), shape(shape), dist(dist) { };
     Intersection_point(): pos(Vec_3d(0, 0, 0)), shape(nullptr), dist(std::numeric_limits<double>::infinity()) { };
-    bool operator<(Intersection_point const & rha){
+    bool operator<(Intersection_point const & rha) const{
         return dist < rha.dist;
     }
-    bool operator>(Intersection_point const & rha){
+    bool operator>(Intersection_point const & rha) const{
         return dist > rha.dist;
     }
 };
 
+// Candidate crossing of a primitive surface; the position is only computed
+// for the candidates that get tested.
+struct Hit{
+    double dist;
+    Shape_base *shape;
+
+    bool operator<(Hit const & rha) const{
+        return dist < rha.dist;
+    }
+};
+
+// Fixed-capacity view over caller-owned storage, sized by Shape_base::max_hits.
+class Hit_buffer{
+private:
+    Hit *data;
+    size_t amm, capacity;
+
+public:
+    Hit_buffer(Hit *data, size_t capacity): data(data), amm(0), capacity(capacity) {};
+
+    void push_back(Hit hit){
+        if (amm < capacity){
+            data[amm++] = hit;
+        }
+    };
+    void clear(){
+        amm = 0;
+    };
+    size_t size() const{
+        return amm;
+    };
+    Hit *begin(){
+        return data;
+    };
+    Hit *end(){
+        return data + amm;
+    };
+};
+
 class Shape_base{
 private:
 
@@ -29,10 +146,20 @@ public:
 
     Shape_base(): parent(nullptr) {};
     virtual ~Shape_base() = default;
-    virtual void get_intersections (Photon photon, std::vector<Intersection_point> &ans) = 0;
-    virtual Vec_3d get_normal (Vec_3d point) = 0;
-
-    virtual bool point_is_inside (Intersection_point inter) = 0;
+    virtual void get_intersections (Photon const &photon, Hit_buffer &ans) = 0;
+    virtual Vec_3d get_normal (Vec_3d const &point) = 0;
+    virtual Aabb get_bounds () = 0;
+    // Upper bound on the hits get_intersections can report
+    virtual size_t max_hits () = 0;
+
+    // surface is the primitive the point lies on, if any
+    virtual bool point_is_inside (Vec_3d const &point, Shape_base const *surface) = 0;
+
+    // Uniformly distributed surface point and its outward normal, for area
+    // lights; false if the shape has no finite surface to sample
+    virtual bool sample_surface (double u_1, double u_2, Vec_3d &point, Vec_3d &normal){
+        return false;
+    };
 };
 
 class Shape_plane: public Shape_base{
@@ -44,20 +171,37 @@ public:
     Shape_plane(Vec_3d pos, Vec_3d normal):pos(pos), normal(normal/normal.len()) { };
 
     ~Shape_plane() = default;
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         Vec_3d pos_rel = photon.pos - pos;
         double dist = - ((pos_rel * normal) / (photon.dir * normal));
 
         if(dist > 0){
-            Vec_3d pos_inter = photon.pos + dist * photon.dir;
-            ans.push_back(Intersection_point(pos_inter, this, dist));
+            ans.push_back(Hit{dist, this});
         }
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         return normal;
     };
-    bool point_is_inside(Intersection_point inter){
-        return this == inter.shape || (inter.pos - pos) * normal < 0;
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return this == surface || (point - pos) * normal < 0;
+    };
+    Aabb get_bounds(){
+        Aabb ans = Aabb::infinite();
+        for (int i=0; i<3; ++i){
+            int j = (i+1)%3, k = (i+2)%3;
+            if (normal[j] != 0 || normal[k] != 0){
+                continue;
+            }
+            if (normal[i] < 0){
+                ans.lo[i] = pos[i];
+            }else{
+                ans.hi[i] = pos[i];
+            }
+        }
+        return ans;
+    };
+    size_t max_hits(){
+        return 1;
     };
 };
 
@@ -71,7 +215,7 @@ public:
     Shape_cylinder(Vec_3d pos, Vec_3d dir, double rad):pos(pos), dir(dir/dir.len()), rad(rad) { };
 
     ~Shape_cylinder() = default;
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         Vec_3d pos_rel = photon.pos - pos;
         Vec_3d pos_radial = pos_rel    - (pos_rel    * dir) * dir;
         Vec_3d dir_radial = photon.dir - (photon.dir * dir) * dir;
@@ -86,19 +230,31 @@ public:
         for (int sign=-1; sign<=1; sign+=2){
             double dist = ( -scalar_radial + sign*std::sqrt(discriminant)) / dir_radial.sqr();
             if (dist > 0) {
-                Vec_3d pos_inter = photon.pos + dist * photon.dir;
-                ans.push_back(Intersection_point(pos_inter, this, dist));
+                ans.push_back(Hit{dist, this});
             }
         }
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         Vec_3d point_rel = point - pos;
         Vec_3d normal_component = point_rel - (point_rel*dir)*dir;
         return normal_component/normal_component.len();
     };
-    bool point_is_inside(Intersection_point inter){
-        Vec_3d pos_rel = inter.pos - pos;
-        return this == inter.shape || pos_rel.sqr() - sqr(pos_rel * dir) < sqr(rad);
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        Vec_3d pos_rel = point - pos;
+        return this == surface || pos_rel.sqr() - sqr(pos_rel * dir) < sqr(rad);
+    };
+    Aabb get_bounds(){
+        Aabb ans = Aabb::infinite();
+        for (int i=0; i<3; ++i){
+            if (dir[i] == 0){
+                ans.lo[i] = pos[i] - rad;
+                ans.hi[i] = pos[i] + rad;
+            }
+        }
+        return ans;
+    };
+    size_t max_hits(){
+        return 2;
     };
 };
 
@@ -112,7 +268,7 @@ public:
     Shape_ball(Vec_3d pos, double rad):pos(pos), rad(rad) { };
 
     ~Shape_ball() = default;
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         Vec_3d pos_rel = photon.pos - pos;
 
         double pos_dot_dir = pos_rel * photon.dir;
@@ -125,20 +281,31 @@ public:
         for (int sign=-1; sign<=1; sign+=2){
             double dist = ( -pos_dot_dir + sign*std::sqrt(discriminant));
             if (dist > 0) {
-                Vec_3d pos_inter = photon.pos + dist * photon.dir;
-                ans.push_back(Intersection_point(pos_inter, this, dist));
+                ans.push_back(Hit{dist, this});
             }
         }
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         Vec_3d point_rel = point - pos;
         return point_rel/point_rel.len();
     };
-    bool point_is_inside(Intersection_point inter){
-        return this == inter.shape || (inter.pos - pos).sqr() < sqr(rad);
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return this == surface || (point - pos).sqr() < sqr(rad);
+    };
+    Aabb get_bounds(){
+        return Aabb(pos - Vec_3d(rad, rad, rad), pos + Vec_3d(rad, rad, rad));
+    };
+    size_t max_hits(){
+        return 2;
+    };
+    bool sample_surface(double u_1, double u_2, Vec_3d &point, Vec_3d &normal){
+        normal = sample_uniform_sphere(u_1, u_2);
+        point = pos + rad * normal;
+        return true;
     };
 };
 
+// The CSG nodes do not own their children: shapes live in the scene Arena.
 class Shape_inversion: public Shape_base{
 private:
 
@@ -149,18 +316,21 @@ public:
         shape->parent = this;
     };
 
-    ~Shape_inversion(){
-        delete shape;
-    };
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         shape->get_intersections(photon, ans);
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         std::cout << "aboba\n";
         return Vec_3d(1, 0, 0);
     };
-    bool point_is_inside(Intersection_point inter){
-        return !(shape->point_is_inside(inter));
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return !(shape->point_is_inside(point, surface));
+    };
+    Aabb get_bounds(){
+        return Aabb::infinite();
+    };
+    size_t max_hits(){
+        return shape->max_hits();
     };
 };
 
@@ -176,20 +346,22 @@ public:
         shape_2->parent = this;
     };
 
-    ~Shape_union(){
-        delete shape_1;
-        delete shape_2;
-    };
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         shape_1->get_intersections(photon, ans);
         shape_2->get_intersections(photon, ans);
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         std::cout << "aboba\n";
         return Vec_3d(1, 0, 0);
     };
-    bool point_is_inside(Intersection_point inter){
-        return shape_1->point_is_inside(inter) || shape_2->point_is_inside(inter);
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return shape_1->point_is_inside(point, surface) || shape_2->point_is_inside(point, surface);
+    };
+    Aabb get_bounds(){
+        return shape_1->get_bounds().merge(shape_2->get_bounds());
+    };
+    size_t max_hits(){
+        return shape_1->max_hits() + shape_2->max_hits();
     };
 };
 
@@ -205,20 +377,22 @@ public:
         shape_2->parent = this;
     }
 
-    ~Shape_intersection(){
-        delete shape_1;
-        delete shape_2;
-    };
-    void get_intersections (Photon photon, std::vector<Intersection_point> &ans){
+    void get_intersections (Photon const &photon, Hit_buffer &ans){
         shape_1->get_intersections(photon, ans);
         shape_2->get_intersections(photon, ans);
     };
-    Vec_3d get_normal(Vec_3d point){
+    Vec_3d get_normal(Vec_3d const &point){
         std::cout << "aboba\n";
         return Vec_3d(1, 0, 0);
     };
-    bool point_is_inside(Intersection_point inter){
-        return shape_1->point_is_inside(inter) && shape_2->point_is_inside(inter);
+    bool point_is_inside(Vec_3d const &point, Shape_base const *surface){
+        return shape_1->point_is_inside(point, surface) && shape_2->point_is_inside(point, surface);
+    };
+    Aabb get_bounds(){
+        return shape_1->get_bounds().overlap(shape_2->get_bounds());
+    };
+    size_t max_hits(){
+        return shape_1->max_hits() + shape_2->max_hits();
     };
 };
 
@@ -234,7 +408,7 @@ public:
         dir_normal /= dir_normal.len();
     };
 
-    double dist(Photon photon){
+    double dist(Photon const &photon) const{
         double ans = - (dir_normal * (photon.pos - pos))/(dir_normal * photon.dir);
         Vec_3d hit_pos = photon.pos + ans*photon.dir - pos;
         if( ans < 0 || sqr(hit_pos * a) > sqr(a.sqr()) || sqr(hit_pos * b) > sqr(b.sqr())){
@@ -242,7 +416,10 @@ public:
         }
         return ans;
     };
-    Vec_3d normal(Photon photon){
+    Vec_3d normal(Photon const &photon) const{
         return dir_normal;
     };
+    Screen transformed(Transform const &tr) const{
+        return Screen(tr.apply(pos), tr.rotate(a), tr.rotate(b));
+    };
 };
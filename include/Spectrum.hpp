@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+class Vec_3d;
+
+const double lambda_min = 380.0;
+const double lambda_max = 780.0;
+
+// Hero wavelength (lambda[0]) plus companions stratified over the visible range.
+// Every path carries the whole bundle, so all wavelengths are traced at once.
+struct Wavelengths{
+    static const size_t count = 4;
+
+    double lambda[count];
+    double weight[count];
+
+    // Keeps only the hero wavelength, e.g. after a dispersive interface.
+    void terminate_secondary(){
+        weight[0] *= count;
+        for (size_t i=1; i<count; ++i){
+            weight[i] = 0.0;
+        }
+    };
+    void scale(double k){
+        for (size_t i=0; i<count; ++i){
+            weight[i] *= k;
+        }
+    };
+    bool secondary_terminated() const{
+        for (size_t i=1; i<count; ++i){
+            if (weight[i] != 0.0) {return false;}
+        }
+        return true;
+    };
+};
+
+Wavelengths rand_wavelengths();
+
+double cie_x(double lambda);
+double cie_y(double lambda);
+double cie_z(double lambda);
+
+Vec_3d spectrum_to_rgb(Wavelengths const &wl);
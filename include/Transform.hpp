@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Vec_3d.hpp"
+
+// Rigid transform: world = R * local + offset
+class Transform{
+private:
+
+public:
+    Vec_3d row[3];
+    Vec_3d offset;
+    bool identity;
+
+    Transform(): row{Vec_3d(1, 0, 0), Vec_3d(0, 1, 0), Vec_3d(0, 0, 1)}, offset(), identity(true) {};
+
+    // rot_vec is axis * angle
+    Transform(Vec_3d offset, Vec_3d rot_vec): offset(offset), identity(false) {
+        double angle = rot_vec.len();
+        Vec_3d k = angle > 0 ? rot_vec / angle : Vec_3d(0, 0, 1);
+        double c = std::cos(angle), s = std::sin(angle), t = 1 - c;
+        row[0] = Vec_3d(t*k.x*k.x + c,     t*k.x*k.y - s*k.z, t*k.x*k.z + s*k.y);
+        row[1] = Vec_3d(t*k.x*k.y + s*k.z, t*k.y*k.y + c,     t*k.y*k.z - s*k.x);
+        row[2] = Vec_3d(t*k.x*k.z - s*k.y, t*k.y*k.z + s*k.x, t*k.z*k.z + c    );
+    };
+
+    // Maps the local x axis to dir and z to the world vertical, placed at origin.
+    static Transform look_at(Vec_3d origin, Vec_3d dir){
+        Vec_3d x = dir / dir.len();
+        Vec_3d y(-x.y, x.x, 0);
+        if (y.sqr() < 1E-18){
+            y = Vec_3d(0, 1, 0);
+        }
+        y /= y.len();
+        Vec_3d z(x.y*y.z - y.y*x.z, x.z*y.x - y.z*x.x, x.x*y.y - y.x*x.y);
+
+        Transform ans;
+        ans.row[0] = Vec_3d(x.x, y.x, z.x);
+        ans.row[1] = Vec_3d(x.y, y.y, z.y);
+        ans.row[2] = Vec_3d(x.z, y.z, z.z);
+        ans.offset = origin;
+        ans.identity = false;
+        return ans;
+    };
+
+    Vec_3d rotate(Vec_3d v) const{
+        return Vec_3d(row[0] * v, row[1] * v, row[2] * v);
+    };
+    Vec_3d rotate_inv(Vec_3d v) const{
+        return v.x * row[0] + v.y * row[1] + v.z * row[2];
+    };
+    Vec_3d apply(Vec_3d p) const{
+        return rotate(p) + offset;
+    };
+    Vec_3d apply_inv(Vec_3d p) const{
+        return rotate_inv(p - offset);
+    };
+    bool is_translation() const{
+        return row[0].x == 1 && row[1].y == 1 && row[2].z == 1;
+    };
+
+    Transform inverse() const{
+        Transform ans;
+        ans.row[0] = Vec_3d(row[0].x, row[1].x, row[2].x);
+        ans.row[1] = Vec_3d(row[0].y, row[1].y, row[2].y);
+        ans.row[2] = Vec_3d(row[0].z, row[1].z, row[2].z);
+        ans.offset = -rotate_inv(offset);
+        ans.identity = identity;
+        return ans;
+    };
+    // (*this * rha).apply(p) == apply(rha.apply(p))
+    Transform operator*(Transform const &rha) const{
+        Vec_3d col_x(rha.row[0].x, rha.row[1].x, rha.row[2].x);
+        Vec_3d col_y(rha.row[0].y, rha.row[1].y, rha.row[2].y);
+        Vec_3d col_z(rha.row[0].z, rha.row[1].z, rha.row[2].z);
+
+        Transform ans;
+        for (int i=0; i<3; ++i){
+            ans.row[i] = Vec_3d(row[i] * col_x, row[i] * col_y, row[i] * col_z);
+        }
+        ans.offset = apply(rha.offset);
+        ans.identity = identity && rha.identity;
+        return ans;
+    };
+};
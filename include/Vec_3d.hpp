@@ -6,6 +6,8 @@
 #include <random>
 #include <chrono>
 
+#include "Spectrum.hpp"
+
 class Vec_3d{
 private:
 
@@ -114,8 +116,9 @@ private:
 public:
     Vec_3d pos, dir;
     bool alive;
+    Wavelengths wl;
 
-    Photon(Vec_3d pos, Vec_3d dir): pos(pos), dir(dir/dir.len()), alive(true) {};
+    Photon(Vec_3d pos, Vec_3d dir): pos(pos), dir(dir/dir.len()), alive(true), wl(rand_wavelengths()) {};
     Photon(Vec_3d pos): Photon(pos, rand_unit_vec()) {};
     Photon(): Photon(Vec_3d()) {};
 };
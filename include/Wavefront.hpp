@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "Light.hpp"
+#include "Recorder.hpp"
+#include "Render.hpp"
+#include "Sampling.hpp"
+
+// Wavefront tracer: a pool of photons in flight is advanced one bounce at a
+// time by separate kernels. After intersection the pool is sorted by event
+// and material, so every kernel runs over a homogeneous batch.
+// Each of settings.thread_amm threads runs its own pool; the pools draw from
+// one photon budget and merge their screen hits under a lock once per bounce.
+class Wavefront{
+private:
+    // Sort keys: one per non-object event, then one per material (key_object + Body::material_ind)
+    static const size_t key_stray  = 0;
+    static const size_t key_screen = 1;
+    static const size_t key_fog    = 2;
+    static const size_t key_object = 3;
+
+    struct Splat{
+        size_t ind;
+        Vec_3d rgb;
+        Path_guide guide;
+    };
+
+    // Path state is kept as one array per field, indexed by a slot that does
+    // not change while the path is in flight: sorting and retiring paths only
+    // move slot indices. Slots in flight are visited in ascending order, and
+    // the sort is stable, so every pass walks the arrays front to back.
+    class Pool{
+    private:
+        Wavefront &wf;
+
+        std::vector<Photon> photon;
+        std::vector<size_t> itr;
+        std::vector<double> dist;
+        std::vector<Intersection_point> inter;
+        std::vector<Body *> body;
+        std::vector<Path_guide> guide;
+        // Only set for paths sampled by the recorder
+        std::vector<Recorded_path *> record;
+
+        std::vector<uint8_t> in_flight;
+        // Slots in flight, the same sorted by key, and the unused ones
+        std::vector<size_t> active, order, free_slots;
+        // Per bounce, by position in active
+        std::vector<double> screen_dist, object_dist, fog_dist, event_dist;
+        std::vector<size_t> key;
+        std::vector<size_t> key_begin, key_next;
+
+        std::vector<Photon> emitted;
+
+        // Results not yet merged into the frame
+        std::vector<Splat> splats;
+        std::vector<size_t> itr_counter;
+
+        void generate();
+        void intersect();
+        void sort();
+        void splat(size_t begin, size_t end);
+        void shade(Material *material, size_t begin, size_t end);
+        void scatter_fog(size_t begin, size_t end);
+        void kill(size_t begin, size_t end);
+        void compact();
+        void gather();
+        void flush();
+
+    public:
+        Pool(Wavefront &wf, size_t capacity);
+
+        void run();
+    };
+
+    Render_settings settings;
+    Bvh &bvh;
+    Light_sampler &lights;
+    Screen screen;
+    Pixel *pixels;
+    Aux_pixel *aux;
+    size_t *itr_counter;
+
+    std::atomic<size_t> launched;
+    // Guards pixels, aux, itr_counter, hit_count and the progress output
+    std::mutex mutex;
+    size_t hit_count;
+
+    // Takes up to amm photons of the budget; returns how many, first is the index of the first one
+    size_t claim(size_t amm, size_t &first);
+
+public:
+    Wavefront(Render_settings const &settings, Bvh &bvh, Light_sampler &lights, Screen screen, Pixel *pixels, Aux_pixel *aux, size_t *itr_counter);
+
+    size_t render();
+};
@@ -2,54 +2,65 @@
 #include <cmath>
 #include <fstream>
 #include <limits>
+#include <thread>
 #include <vector>
 
 #include "include/Vec_3d.hpp"
 #include "include/Material.hpp"
 #include "include/Shape.hpp"
 #include "include/Scene.hpp"
-
-struct Pixel{
-    unsigned int r, g, b;
-
-    void add(unsigned char r_add, unsigned char g_add, unsigned char b_add){
-        r += r_add;
-        g += g_add;
-        b += b_add;
-
-        if (r>255) r = 255;
-        if (g>255) g = 255;
-        if (b>255) b = 255;
-    }
-};
-
-void print_ppm(Pixel *pixels, int width, int height, std::string name){
-    std::ofstream out(name + ".ppm");
-    out << "P3" << " " << width << " " << height << " " << "255" << "\n";
-    for (int i_y=0; i_y<height; ++i_y){
-        for (int i_x=0; i_x<width; ++i_x){
-            Pixel curr = pixels[i_x + width * i_y];
-            out << curr.r << " " << curr.g << " " << curr.b << " \n";
-        }
+#include "include/Bvh.hpp"
+#include "include/Light.hpp"
+#include "include/Render.hpp"
+#include "include/Denoise.hpp"
+#include "include/Preview.hpp"
+#include "include/Recorder.hpp"
+
+std::string frame_name(std::string name, size_t frame){
+    std::string num = std::to_string(frame);
+    if (num.size() < 4){
+        num.insert(0, 4 - num.size(), '0');
     }
-    out.close();
+    return name + "_" + num;
 }
 
-enum class Photon_event {stray, screen, object, fog};
-
 int main()
 {
-    bool fog_present = false;
-    double fog_coef = 0.0;
-
-    size_t max_itr = 15;
+    Render_settings settings;
+    settings.fog_present = false;
+    settings.fog_coef = 0.0;
+    settings.max_itr = 15;
+    settings.eps = 1E-6;
+    settings.ray_amm = 5E8;
+    settings.width = 640;
+    settings.height = 640;
+    settings.wavefront = true;
+    settings.pool_size = 1 << 11;
+    settings.thread_amm = std::max(1u, std::thread::hardware_concurrency());
+    settings.preview = nullptr;
+    settings.frame = 0;
+    settings.recorder = nullptr;
+
+    // Publish the image in progress as /dev/shm/ray_1 (see tools/preview_snapshot.cpp)
+    bool live_preview = true;
+
+    // Log every record_period-th photon path to paths.bin (see tools/path_log.cpp), 0 to disable
+    size_t record_period = 0;
+
+    // Sequence mode renders frame_amm frames of the scene animation into pic_XXXX.ppm
+    bool sequence = false;
+    size_t frame_amm = 24;
+
+    // Run the edge-aware denoiser on the finished image, written as pic_denoised.ppm
+    bool denoise_image = true;
+    Denoise_settings denoise_settings = default_denoise_settings();
+
+    size_t max_itr = settings.max_itr;
     size_t *itr_counter = new size_t[max_itr]();
-    double eps = 1E-6;
-    size_t ray_amm = 5E8;
-    size_t hit_count = 0;
 
-    size_t width = 640, height = 640;
+    size_t width = settings.width, height = settings.height;
     Pixel *pixels = new Pixel[width*height]();
+    Aux_pixel *aux = new Aux_pixel[width*height]();
 
 //    std::ifstream in("pic.ppm");
 //    {
@@ -65,96 +76,102 @@ int main()
 //    }
 //    in.close();
 
-    std::vector<Body *> scene = init_scene_3();
+    // Owns every shape, material and body of the scene
+    Arena arena;
+    std::vector<Body *> scene = init_scene_3(arena);
 
     Vec_3d camera_pos (-15,  30,  15);
     Vec_3d camera_targ( -3,   0,   6);
-    std::pair<Screen, Body *> camera = make_camera(camera_pos, camera_targ-camera_pos, (camera_targ-camera_pos).len());
+    std::pair<Screen, Body *> camera = make_camera(arena, camera_pos, camera_targ-camera_pos, (camera_targ-camera_pos).len());
 
     Screen screen = camera.first;
     scene.push_back(camera.second);
 
-    for (size_t i=1; i<=ray_amm; ++i){
-        Photon photon = cone_source(Vec_3d(-10, 5, 25), Vec_3d(10, -5, -15), std::acos(0)/8);
+    Bvh bvh(scene);
 
-        size_t itr = 0;
-        while (photon.alive && itr < max_itr) {
-            ++itr;
+    std::vector<Light_base *> lights = init_lights(arena, scene);
+    Light_sampler light_sampler(lights);
+    light_sampler.focus(camera_targ);
 
-            double screen_dist = screen.dist(photon);
+    Preview *preview = nullptr;
+    if (live_preview){
+        preview = new Preview("/ray_1", width, height);
+        settings.preview = preview;
+    }
 
-            Intersection_point closest_inter;
-            Body *closest_body = nullptr;
-            for (auto body : scene){
-                Intersection_point inter = body->get_intersection(photon);
-                if (closest_inter > inter){
-                    closest_inter = inter;
-                    closest_body = body;
-                }
-            }
+    Path_recorder *recorder = nullptr;
+    if (record_period > 0){
+        recorder = new Path_recorder("paths.bin", scene, record_period);
+        settings.recorder = recorder;
+    }
 
-            double fog_dist = std::numeric_limits<double>::infinity();
-            if (fog_present){
-                fog_dist = -1.0 * std::log(rand_uns(0, 1.0)) / fog_coef;
-            }
+    if (!sequence){
+        size_t hit_count = render_frame(settings, bvh, light_sampler, screen, pixels, aux, itr_counter);
+        std::cout << "\n" << hit_count << "\n";
+        print_ppm(pixels, width, height, "pic");
 
-            double min_dist = std::numeric_limits<double>::infinity();
-            Photon_event event = Photon_event::stray;
-            if (min_dist > screen_dist){
-                min_dist = screen_dist;
-                event = Photon_event::screen;
-            }
-            if (min_dist > closest_inter.dist){
-                min_dist = closest_inter.dist;
-                event = Photon_event::object;
+        if (denoise_image){
+            Pixel *denoised = new Pixel[width*height]();
+            denoise(pixels, aux, denoised, width, height, denoise_settings);
+            print_ppm(denoised, width, height, "pic_denoised");
+            delete[] denoised;
+        }
+    }else{
+        Camera_keyframe camera_ref{0.0, camera_pos, camera_targ};
+        Animation animation = init_animation_3(scene, camera_ref);
+
+        // The finished frame is denoised and written by a separate thread while
+        // the next one is traced, as pic_XXXX.ppm and pic_denoised_XXXX.ppm.
+        Pixel *pixels_out = new Pixel[width*height]();
+        Aux_pixel *aux_out = new Aux_pixel[width*height]();
+        Pixel *denoised = new Pixel[width*height]();
+        std::thread writer;
+
+        for (size_t frame=0; frame<frame_amm; ++frame){
+            double time = frame_amm > 1 ? 1.0 * frame / (frame_amm - 1) : 0.0;
+            settings.frame = frame;
+
+            bool moved = animation.apply(time);
+            Vec_3d focus = camera_targ;
+            if (!animation.camera.keys.empty()){
+                Camera_keyframe camera_curr = animation.camera.at(time);
+                Transform camera_tr = camera_transform(camera_ref, camera_curr);
+                focus = camera_curr.targ;
+                camera.second->set_transform(camera_tr);
+                screen = camera.first.transformed(camera_tr);
+                moved = true;
             }
-            if (min_dist > fog_dist){
-                min_dist = fog_dist;
-                event = Photon_event::fog;
+            if (moved){
+                bvh.refit();
+                light_sampler.refit();
             }
+            light_sampler.focus(focus);
+
+            size_t hit_count = render_frame(settings, bvh, light_sampler, screen, pixels, aux, itr_counter);
+            std::cout << "\nframe " << frame << ": " << hit_count << "\n";
 
-            if(event == Photon_event::stray){
-                photon.alive = false;
-            }else if(event == Photon_event::screen){
-                photon.pos += screen_dist * photon.dir;
-
-                double rel_x = (-1.0 * ((photon.pos - screen.pos) * screen.a) / screen.a.sqr() + 1.0) / 2.0;
-                double rel_y = ( 1.0 * ((photon.pos - screen.pos) * screen.b) / screen.b.sqr() + 1.0) / 2.0;
-                size_t screen_x = rel_x * width;
-                size_t screen_y = rel_y * height;
-                pixels[screen_x + width * screen_y].add(1, 0, 0);
-
-                ++hit_count;
-                photon.alive = false;
-            }else if (event == Photon_event::object){
-                photon.pos = closest_inter.pos;
-                Vec_3d normal = closest_inter.shape->get_normal(closest_inter.pos);
-                closest_body->interact(photon, normal);
-                photon.pos += eps * photon.dir;
-            }else if (event == Photon_event::fog){
-                photon.pos += photon.dir * fog_dist;
-                photon.dir = rand_unit_vec();
-                //photon.alive = false;
+            if (writer.joinable()){
+                writer.join();
             }
+            std::swap(pixels, pixels_out);
+            std::swap(aux, aux_out);
+            writer = std::thread([=, &denoise_settings](){
+                print_ppm(pixels_out, width, height, frame_name("pic", frame));
+                if (denoise_image){
+                    denoise(pixels_out, aux_out, denoised, width, height, denoise_settings);
+                    print_ppm(denoised, width, height, frame_name("pic_denoised", frame));
+                }
+            });
+            std::fill(pixels, pixels + width*height, Pixel());
+            std::fill(aux, aux + width*height, Aux_pixel());
         }
-        ++itr_counter[itr-1];
-        if (i%100000 == 0){
-            std::cout << 100.0 * i/ray_amm << "%" << "\n";
-            std::cout << i << "\n";
-            std::cout << hit_count << "\n";
-            std::cout << 1.0 * hit_count/i << "\n";
-            std::cout << "\n";
-            for(size_t i=0; i<max_itr; ++i){
-                std::cout << i+1 << ":  " << itr_counter[i] << "\n";
-            }
-            std::cout << "\n\n";
+        if (writer.joinable()){
+            writer.join();
         }
-//        if (i%(10 * ray_amm/100) == 0){
-//            print_ppm(pixels, width, height, "pic");// + std::to_string(i/(ray_amm/100)));
-//        }
+        delete[] pixels_out;
+        delete[] aux_out;
+        delete[] denoised;
     }
-    std::cout << "\n" << hit_count << "\n";
-    print_ppm(pixels, width, height, "pic");
 
 //    size_t ans = 0;
 //    for (size_t i=0; i<width*height; ++i){
@@ -162,9 +179,13 @@ int main()
 //    }
 //    std::cout << ans << "\n";
 
-    delete[] pixels;
-    for (auto body : scene){
-        delete body;
+    if (recorder){
+        std::cout << "paths dropped: " << recorder->dropped_amm() << "\n";
     }
+    delete recorder;
+    delete preview;
+    delete[] pixels;
+    delete[] aux;
+    delete[] itr_counter;
     return 0;
 }
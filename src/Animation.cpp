@@ -0,0 +1,70 @@
+#include "../include/Animation.hpp"
+
+template <class Key>
+static void insert_sorted(std::vector<Key> &keys, Key key){
+    auto it = std::upper_bound(keys.begin(), keys.end(), key,
+        [](Key const &lha, Key const &rha){ return lha.time < rha.time; });
+    keys.insert(it, key);
+}
+
+// Index of the last key not later than time and the blend factor towards the next one.
+template <class Key>
+static std::pair<size_t, double> locate(std::vector<Key> const &keys, double time){
+    size_t ind = 0;
+    while (ind + 1 < keys.size() && keys[ind+1].time <= time){
+        ++ind;
+    }
+    if (ind + 1 == keys.size() || time <= keys[ind].time){
+        return std::make_pair(ind, 0.0);
+    }
+    double k = (time - keys[ind].time) / (keys[ind+1].time - keys[ind].time);
+    return std::make_pair(ind, k);
+}
+
+void Track::add(Keyframe key){
+    insert_sorted(keys, key);
+}
+
+Transform Track::at(double time) const{
+    if (keys.empty()){
+        return Transform();
+    }
+    auto [ind, k] = locate(keys, time);
+    if (k == 0){
+        return Transform(keys[ind].offset, keys[ind].rot_vec);
+    }
+    Keyframe const &a = keys[ind];
+    Keyframe const &b = keys[ind+1];
+    return Transform(a.offset + k*(b.offset - a.offset), a.rot_vec + k*(b.rot_vec - a.rot_vec));
+}
+
+void Camera_track::add(Camera_keyframe key){
+    insert_sorted(keys, key);
+}
+
+Camera_keyframe Camera_track::at(double time) const{
+    auto [ind, k] = locate(keys, time);
+    if (k == 0){
+        return keys[ind];
+    }
+    Camera_keyframe const &a = keys[ind];
+    Camera_keyframe const &b = keys[ind+1];
+    return Camera_keyframe{time, a.pos + k*(b.pos - a.pos), a.targ + k*(b.targ - a.targ)};
+}
+
+bool Animation::apply(double time){
+    bool moved = false;
+    for (auto &[body, track] : bodies){
+        Transform tr = track.at(time);
+        bool same = true;
+        for (int i=0; i<3; ++i){
+            same = same && (tr.row[i] - body->transform.row[i]).sqr() == 0;
+        }
+        same = same && (tr.offset - body->transform.offset).sqr() == 0;
+        if (!same){
+            body->set_transform(tr);
+            moved = true;
+        }
+    }
+    return moved;
+}
@@ -0,0 +1,119 @@
+#include "../include/Bvh.hpp"
+
+Bvh::Bvh(std::vector<Body *> const &scene): hit_capacity(0) {
+    std::vector<Body *> bounded;
+    std::unordered_map<Material *, size_t> material_ind;
+    for (auto body : scene){
+        auto it = material_ind.find(body->material);
+        if (it == material_ind.end()){
+            it = material_ind.emplace(body->material, materials.size()).first;
+            materials.push_back(body->material);
+        }
+        body->material_ind = it->second;
+
+        hit_capacity = std::max(hit_capacity, body->max_hits);
+        if (body->bounds.is_finite()){
+            bounded.push_back(body);
+        }else{
+            unbounded.push_back(body);
+        }
+    }
+    if (!bounded.empty()){
+        nodes.reserve(2 * bounded.size());
+        build(bounded, 0, bounded.size());
+    }
+}
+
+int Bvh::build(std::vector<Body *> &bodies, size_t begin, size_t end){
+    int ind = nodes.size();
+    nodes.push_back(Node{bodies[begin]->bounds, -1, -1, nullptr});
+
+    if (end - begin == 1){
+        nodes[ind].body = bodies[begin];
+        return ind;
+    }
+
+    Aabb box;
+    size_t mid = median_split(bodies, begin, end, [](Body *body){ return body->bounds; }, box);
+
+    int left  = build(bodies, begin, mid);
+    int right = build(bodies, mid, end);
+    nodes[ind].left  = left;
+    nodes[ind].right = right;
+    nodes[ind].box = box;
+    return ind;
+}
+
+void Bvh::refit(){
+    if (!nodes.empty()){
+        refit(0);
+    }
+}
+
+Aabb Bvh::refit(int node){
+    Node &curr = nodes[node];
+    if (curr.body){
+        curr.box = curr.body->bounds;
+    }else{
+        curr.box = refit(curr.left).merge(refit(curr.right));
+    }
+    return curr.box;
+}
+
+Body *Bvh::get_intersection(Photon const &photon, Intersection_point &closest_inter){
+    if (hit_capacity <= inline_hits){
+        Hit storage[inline_hits];
+        Hit_buffer hits(storage, hit_capacity);
+        return get_intersection(photon, closest_inter, hits);
+    }
+    thread_local std::vector<Hit> storage;
+    if (storage.size() < hit_capacity){
+        storage.resize(hit_capacity);
+    }
+    Hit_buffer hits(storage.data(), hit_capacity);
+    return get_intersection(photon, closest_inter, hits);
+}
+
+Body *Bvh::get_intersection(Photon const &photon, Intersection_point &closest_inter, Hit_buffer &hits){
+    Body *closest_body = nullptr;
+
+    for (auto body : unbounded){
+        Intersection_point inter = body->get_intersection(photon, hits);
+        if (closest_inter > inter){
+            closest_inter = inter;
+            closest_body = body;
+        }
+    }
+    if (nodes.empty()){
+        return closest_body;
+    }
+
+    int stack[64];
+    int stack_size = 0;
+    if (nodes[0].box.hit_dist(photon, closest_inter.dist) < closest_inter.dist){
+        stack[stack_size++] = 0;
+    }
+    while (stack_size > 0){
+        Node &curr = nodes[stack[--stack_size]];
+        if (curr.body){
+            Intersection_point inter = curr.body->get_intersection(photon, hits);
+            if (closest_inter > inter){
+                closest_inter = inter;
+                closest_body = curr.body;
+            }
+            continue;
+        }
+
+        double dist_l = nodes[curr.left ].box.hit_dist(photon, closest_inter.dist);
+        double dist_r = nodes[curr.right].box.hit_dist(photon, closest_inter.dist);
+        int near = curr.left, far = curr.right;
+        if (dist_r < dist_l){
+            std::swap(near, far);
+            std::swap(dist_l, dist_r);
+        }
+        // push the far child first so the near one is visited first
+        if (dist_r < closest_inter.dist) {stack[stack_size++] = far;}
+        if (dist_l < closest_inter.dist) {stack[stack_size++] = near;}
+    }
+    return closest_body;
+}
@@ -0,0 +1,147 @@
+#include "../include/Denoise.hpp"
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+Denoise_settings default_denoise_settings(){
+    Denoise_settings ds;
+    ds.radius = 5;
+    ds.sigma_space = 3.0;
+    ds.sigma_color = 2.0;
+    ds.sigma_normal = 0.1;
+    ds.sigma_depth = 0.05;
+    ds.tile_size = 64;
+    ds.thread_amm = std::max(1u, std::thread::hardware_concurrency());
+    return ds;
+}
+
+namespace {
+
+// Positive, decreasing stand-in for exp(-e), e >= 0 (truncated Taylor series of exp(e)
+// in the denominator); unlike std::exp it lets the window loop vectorize.
+inline float fast_exp_neg(float e){
+    float p = 1 + e * (1 + e * (0.5f + e * (1.0f/6 + e * (1.0f/24))));
+    return 1 / p;
+}
+
+// Guide and colour planes laid out separately so the window loops stream through memory.
+struct Planes{
+    std::vector<float> r, g, b, noise;
+    std::vector<float> nx, ny, nz, depth;
+    std::vector<int> id;
+
+    Planes(Pixel const *pixels, Aux_pixel const *aux, size_t size):
+        r(size), g(size), b(size), noise(size), nx(size), ny(size), nz(size), depth(size), id(size) {
+        std::unordered_map<Body const *, int> body_id;
+        for (size_t i=0; i<size; ++i){
+            r[i] = pixels[i].r;
+            g[i] = pixels[i].g;
+            b[i] = pixels[i].b;
+            noise[i] = std::max(1.0, (pixels[i].r + pixels[i].g + pixels[i].b) / 3);
+
+            Aux_pixel const &a = aux[i];
+            if (a.count == 0){
+                id[i] = -1;
+                continue;
+            }
+            double n_len = a.normal.len();
+            Vec_3d n = n_len > 0 ? a.normal / n_len : Vec_3d();
+            nx[i] = n.x;
+            ny[i] = n.y;
+            nz[i] = n.z;
+            depth[i] = a.depth / a.count;
+
+            auto it = body_id.emplace(a.body, body_id.size()).first;
+            id[i] = it->second;
+        }
+    };
+};
+
+void filter_tile(Planes const &pl, Pixel *out, size_t width, size_t height,
+                 size_t x_0, size_t y_0, size_t x_1, size_t y_1,
+                 Denoise_settings const &ds, std::vector<float> const &space_weight){
+    const int rad = ds.radius;
+    const float inv_color  = 1.0 / (2 * sqr(ds.sigma_color));
+    const float inv_normal = 1.0 / ds.sigma_normal;
+    const float inv_depth  = 1.0 / (2 * sqr(ds.sigma_depth));
+
+    for (size_t y=y_0; y<y_1; ++y){
+        int wy_0 = std::max(0, int(y) - rad), wy_1 = std::min(int(height) - 1, int(y) + rad);
+        for (size_t x=x_0; x<x_1; ++x){
+            int wx_0 = std::max(0, int(x) - rad), wx_1 = std::min(int(width) - 1, int(x) + rad);
+            size_t c = x + width * y;
+
+            float r_c = pl.r[c], g_c = pl.g[c], b_c = pl.b[c];
+            float nx_c = pl.nx[c], ny_c = pl.ny[c], nz_c = pl.nz[c];
+            float depth_c = pl.depth[c];
+            float inv_depth_c = depth_c > 0 ? inv_depth / (depth_c * depth_c) : 0;
+            float inv_color_c = inv_color / pl.noise[c];
+            int id_c = pl.id[c];
+
+            float sum_w = 0, sum_r = 0, sum_g = 0, sum_b = 0;
+            for (int wy=wy_0; wy<=wy_1; ++wy){
+                const float *sw = &space_weight[(wy - int(y) + rad) * (2*rad + 1)];
+                size_t row = width * wy;
+                // The sums may be reordered, which plain -O2 never allows for floats
+                #pragma omp simd reduction(+:sum_w, sum_r, sum_g, sum_b)
+                for (int wx=wx_0; wx<=wx_1; ++wx){
+                    size_t i = row + wx;
+                    float d_r = pl.r[i] - r_c, d_g = pl.g[i] - g_c, d_b = pl.b[i] - b_c;
+                    float d_depth = pl.depth[i] - depth_c;
+                    float cos_n = nx_c * pl.nx[i] + ny_c * pl.ny[i] + nz_c * pl.nz[i];
+
+                    float e = (d_r*d_r + d_g*d_g + d_b*d_b) * inv_color_c
+                            + (1 - std::abs(cos_n)) * inv_normal
+                            + d_depth * d_depth * inv_depth_c;
+                    float w = (pl.id[i] == id_c) * sw[wx - int(x) + rad] * fast_exp_neg(e);
+
+                    sum_w += w;
+                    sum_r += w * pl.r[i];
+                    sum_g += w * pl.g[i];
+                    sum_b += w * pl.b[i];
+                }
+            }
+            out[c].r = sum_r / sum_w;
+            out[c].g = sum_g / sum_w;
+            out[c].b = sum_b / sum_w;
+        }
+    }
+}
+
+}
+
+void denoise(Pixel const *pixels, Aux_pixel const *aux, Pixel *out, size_t width, size_t height, Denoise_settings const &ds){
+    Planes planes(pixels, aux, width * height);
+
+    const int rad = ds.radius;
+    std::vector<float> space_weight((2*rad + 1) * (2*rad + 1));
+    for (int dy=-rad; dy<=rad; ++dy){
+        for (int dx=-rad; dx<=rad; ++dx){
+            space_weight[(dy + rad) * (2*rad + 1) + dx + rad] = std::exp(-(dx*dx + dy*dy) / (2 * sqr(ds.sigma_space)));
+        }
+    }
+
+    size_t tiles_x = (width  + ds.tile_size - 1) / ds.tile_size;
+    size_t tiles_y = (height + ds.tile_size - 1) / ds.tile_size;
+    std::atomic<size_t> next_tile(0);
+
+    auto worker = [&](){
+        for (size_t tile = next_tile++; tile < tiles_x * tiles_y; tile = next_tile++){
+            size_t x_0 = (tile % tiles_x) * ds.tile_size;
+            size_t y_0 = (tile / tiles_x) * ds.tile_size;
+            size_t x_1 = std::min(width,  x_0 + ds.tile_size);
+            size_t y_1 = std::min(height, y_0 + ds.tile_size);
+            filter_tile(planes, out, width, height, x_0, y_0, x_1, y_1, ds, space_weight);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<ds.thread_amm; ++i){
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads){
+        thread.join();
+    }
+}
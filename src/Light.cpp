@@ -0,0 +1,208 @@
+#include "../include/Light.hpp"
+
+#include <iostream>
+#include <queue>
+
+namespace {
+
+thread_local Dir_batch light_dirs;
+thread_local std::vector<size_t> cluster_counts;
+
+}
+
+void Light_cone::emit(Rng &rng, size_t amm, std::vector<Photon> &ans){
+    Dir_batch &dirs = light_dirs;
+    sample_cone(rng, amm, onb, cos_max, dirs);
+    for (size_t i=0; i<amm; ++i){
+        ans.push_back(Photon(pos, dirs[i]));
+    }
+}
+
+Photon Light_body::emit(Rng &rng){
+    Vec_3d point, normal;
+    double u_1 = rng.uniform();
+    body->shape->sample_surface(u_1, rng.uniform(), point, normal);
+    u_1 = rng.uniform();
+    Vec_3d dir = Onb(normal).to_world(sample_cosine(u_1, rng.uniform()));
+
+    if (!body->transform.identity){
+        point = body->transform.apply(point);
+        dir = body->transform.rotate(dir);
+    }
+    return Photon(point, dir);
+}
+
+std::vector<Light_base *> emissive_lights(Arena &arena, std::vector<Body *> const &scene){
+    std::vector<Light_base *> ans;
+    for (auto body : scene){
+        if (body->material->emitted_power() <= 0){
+            continue;
+        }
+        Vec_3d point, normal;
+        if (!body->shape->sample_surface(0.5, 0.5, point, normal)){
+            std::cerr << "lights: " << body->name << " has no surface to emit from\n";
+            continue;
+        }
+        ans.push_back(arena.make<Light_body>(body));
+    }
+    return ans;
+}
+
+Light_tree::Light_tree(std::vector<Light_base *> const &lights): lights(lights) {
+    if (lights.empty()){
+        return;
+    }
+    nodes.reserve(2 * lights.size());
+    build(0, this->lights.size());
+
+    // The build has settled the leaf order, so every node's range is final
+    for (auto &node : nodes){
+        std::vector<double> powers;
+        for (size_t i=node.begin; i<node.end; ++i){
+            powers.push_back(this->lights[i]->power());
+        }
+        tables.push_back(Alias_table(powers));
+    }
+}
+
+int Light_tree::build(size_t begin, size_t end){
+    int ind = nodes.size();
+    nodes.push_back(Node{lights[begin]->get_bounds(), lights[begin]->power(), -1, -1, begin, end});
+
+    if (end - begin == 1){
+        return ind;
+    }
+
+    Aabb box;
+    size_t mid = median_split(lights, begin, end, [](Light_base *light){ return light->get_bounds(); }, box);
+
+    int left  = build(begin, mid);
+    int right = build(mid, end);
+    nodes[ind].left  = left;
+    nodes[ind].right = right;
+    nodes[ind].box = box;
+    nodes[ind].power = nodes[left].power + nodes[right].power;
+    return ind;
+}
+
+void Light_tree::refit(){
+    if (!nodes.empty()){
+        refit(0);
+    }
+}
+
+void Light_tree::refit(int node){
+    Node &curr = nodes[node];
+    if (curr.left < 0){
+        curr.box = lights[curr.begin]->get_bounds();
+        return;
+    }
+    refit(curr.left);
+    refit(curr.right);
+    curr.box = nodes[curr.left].box.merge(nodes[curr.right].box);
+}
+
+double Light_tree::spread(int node, Vec_3d const &viewer) const{
+    Node const &curr = nodes[node];
+    if (curr.left < 0){
+        return 0;
+    }
+    double half_diag = (curr.box.hi - curr.box.lo).len() / 2;
+    return half_diag / std::max((curr.box.center() - viewer).len(), 1E-12);
+}
+
+void Light_tree::cut(Vec_3d const &viewer, double max_spread, size_t cut_max, std::vector<int> &ans) const{
+    ans.clear();
+    if (nodes.empty()){
+        return;
+    }
+    std::priority_queue< std::pair<double, int> > open;
+    open.push(std::make_pair(spread(0, viewer), 0));
+    while (open.size() < cut_max && open.top().first > max_spread){
+        int node = open.top().second;
+        open.pop();
+        open.push(std::make_pair(spread(nodes[node].left,  viewer), nodes[node].left));
+        open.push(std::make_pair(spread(nodes[node].right, viewer), nodes[node].right));
+    }
+    for (; !open.empty(); open.pop()){
+        ans.push_back(open.top().second);
+    }
+}
+
+// The distance is kept at least the half diagonal of the box, so that a
+// viewer inside a cluster sees it as close.
+double Light_tree::importance(int node, Vec_3d const &viewer) const{
+    Node const &curr = nodes[node];
+    double dist_sqr = std::max((curr.box.center() - viewer).sqr(), (curr.box.hi - curr.box.lo).sqr() / 4);
+    return curr.power / std::max(dist_sqr, 1E-12);
+}
+
+static std::vector<Light_base *> powered(std::vector<Light_base *> const &lights){
+    std::vector<Light_base *> ans;
+    for (auto light : lights){
+        if (light->power() > 0){
+            ans.push_back(light);
+        }
+    }
+    return ans;
+}
+
+// Until focused, the whole tree is one cluster and lights are picked by power
+Light_sampler::Light_sampler(std::vector<Light_base *> const &lights, double power_share, double max_spread, size_t cut_max):
+    tree(powered(lights)), power_share(power_share), max_spread(max_spread), cut_max(cut_max) {
+    if (!tree.empty()){
+        clusters.push_back(0);
+        weight.push_back(1.0);
+        table = Alias_table(weight);
+    }
+}
+
+void Light_sampler::focus(Vec_3d const &viewer){
+    if (tree.empty()){
+        return;
+    }
+    tree.cut(viewer, max_spread, cut_max, clusters);
+
+    std::vector<double> prob(clusters.size());
+    double total_imp = 0;
+    for (size_t k=0; k<clusters.size(); ++k){
+        prob[k] = tree.importance(clusters[k], viewer);
+        total_imp += prob[k];
+    }
+    // Within a cluster lights go by power either way, so mixing the two
+    // choices per cluster gives every light the mixed probability.
+    weight.resize(clusters.size());
+    for (size_t k=0; k<clusters.size(); ++k){
+        double share = tree.power(clusters[k]) / tree.power(0);
+        double focused = total_imp > 0 ? prob[k] / total_imp : share;
+        prob[k] = power_share * share + (1 - power_share) * focused;
+        weight[k] = share / prob[k];
+    }
+    table = Alias_table(prob);
+}
+
+void Light_sampler::emit(Rng &rng, size_t amm, std::vector<Photon> &ans){
+    // Drawing the count of every cluster first gives the same distribution as
+    // choosing per photon, and lets single lights emit as one batch.
+    std::vector<size_t> &counts = cluster_counts;
+    counts.assign(clusters.size(), 0);
+    for (size_t i=0; i<amm; ++i){
+        ++counts[table.sample(rng.uniform())];
+    }
+    for (size_t k=0; k<clusters.size(); ++k){
+        if (counts[k] == 0){
+            continue;
+        }
+        size_t first = ans.size();
+        if (tree.light_amm(clusters[k]) == 1){
+            tree.sample(clusters[k], 0)->emit(rng, counts[k], ans);
+        }else{
+            for (size_t i=0; i<counts[k]; ++i){
+                ans.push_back(tree.sample(clusters[k], rng.uniform())->emit(rng));
+            }
+        }
+        for (size_t i=first; i<ans.size(); ++i){
+            ans[i].wl.scale(weight[k]);
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include "../include/Preview.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the preview seqlock needs a lock-free 64-bit atomic");
+
+static size_t data_offset(){
+    return (sizeof(Preview_header) + 63) / 64 * 64;
+}
+
+// True unless the segment carries the pid of a process that is gone. One
+// without a valid header counts as stale too.
+static bool owner_alive(std::string const &name){
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0){
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Preview_header)){
+        close(fd);
+        return false;
+    }
+    void *ptr = mmap(nullptr, sizeof(Preview_header), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED){
+        return false;
+    }
+    Preview_header const *hdr = static_cast<Preview_header const *>(ptr);
+    bool valid = std::memcmp(hdr->magic, preview_magic, sizeof(preview_magic)) == 0 &&
+                 hdr->version == preview_version && hdr->owner_pid > 0;
+    pid_t pid = valid ? pid_t(hdr->owner_pid) : 0;
+    munmap(ptr, sizeof(Preview_header));
+    // EPERM: the process exists but belongs to someone else
+    return valid && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+Preview::Preview(std::string name, size_t width, size_t height):
+    name(name), width(width), height(height), size(data_offset() + 3 * width * height * sizeof(float)),
+    mem(nullptr), header(nullptr), data(nullptr) {
+    // Exclusive, so that a second render cannot write over (and later unlink) a live segment
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST){
+        if (owner_alive(name)){
+            std::cerr << "preview: " << name << " is taken by another running render; rendering without preview\n";
+            return;
+        }
+        std::cerr << "preview: taking over " << name << " left by a render that is no longer running\n";
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 && errno == EEXIST){
+            std::cerr << "preview: " << name << " was taken meanwhile; rendering without preview\n";
+            return;
+        }
+    }
+    if (fd < 0){
+        std::cerr << "preview: shm_open " << name << " failed\n";
+        return;
+    }
+    if (ftruncate(fd, size) != 0){
+        std::cerr << "preview: ftruncate " << name << " failed\n";
+        close(fd);
+        shm_unlink(name.c_str());
+        return;
+    }
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED){
+        std::cerr << "preview: mmap " << name << " failed\n";
+        shm_unlink(name.c_str());
+        return;
+    }
+    mem = ptr;
+
+    header = new (mem) Preview_header();
+    std::memcpy(header->magic, preview_magic, sizeof(preview_magic));
+    header->version = preview_version;
+    header->width = width;
+    header->height = height;
+    header->data_offset = data_offset();
+    header->owner_pid = getpid();
+    header->sequence.store(0, std::memory_order_release);
+    data = reinterpret_cast<float *>(static_cast<char *>(mem) + data_offset());
+}
+
+Preview::~Preview(){
+    if (mem){
+        munmap(mem, size);
+        shm_unlink(name.c_str());
+    }
+}
+
+void Preview::publish(Pixel const *pixels, size_t photon_count, size_t hit_count, size_t frame){
+    if (!mem){
+        return;
+    }
+    uint64_t seq = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i=0; i<width*height; ++i){
+        data[3*i + 0] = pixels[i].r;
+        data[3*i + 1] = pixels[i].g;
+        data[3*i + 2] = pixels[i].b;
+    }
+    header->photon_count = photon_count;
+    header->hit_count = hit_count;
+    header->frame = frame;
+
+    header->sequence.store(seq + 2, std::memory_order_release);
+}
+
+Preview_reader::Preview_reader(std::string name): size(0), mem(nullptr), header(nullptr) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0){
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Preview_header)){
+        close(fd);
+        return;
+    }
+    void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED){
+        return;
+    }
+
+    Preview_header const *hdr = static_cast<Preview_header const *>(ptr);
+    size_t needed = hdr->data_offset + 3 * size_t(hdr->width) * hdr->height * sizeof(float);
+    if (std::memcmp(hdr->magic, preview_magic, sizeof(preview_magic)) != 0 ||
+        hdr->version != preview_version || size_t(st.st_size) < needed){
+        munmap(ptr, st.st_size);
+        return;
+    }
+    size = st.st_size;
+    mem = ptr;
+    header = hdr;
+}
+
+Preview_reader::~Preview_reader(){
+    if (mem){
+        munmap(mem, size);
+    }
+}
+
+bool Preview_reader::snapshot(float *rgb, uint64_t &photon_count, uint64_t &frame, uint64_t &sequence, double timeout) const{
+    float const *data = reinterpret_cast<float const *>(static_cast<char const *>(mem) + header->data_offset);
+    size_t amm = 3 * size_t(header->width) * header->height;
+
+    // A writer that died mid-update leaves the sequence odd for good
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    while (std::chrono::steady_clock::now() < deadline){
+        uint64_t seq_1 = header->sequence.load(std::memory_order_acquire);
+        if (seq_1 & 1){
+            sched_yield();
+            continue;
+        }
+        std::memcpy(rgb, data, amm * sizeof(float));
+        photon_count = header->photon_count;
+        frame = header->frame;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == seq_1){
+            sequence = seq_1;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,174 @@
+#include "../include/Recorder.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cxxabi.h>
+#include <typeinfo>
+
+void put_varint(std::vector<uint8_t> &buf, uint64_t val){
+    while (val >= 0x80){
+        buf.push_back(uint8_t(val) | 0x80);
+        val >>= 7;
+    }
+    buf.push_back(uint8_t(val));
+}
+
+uint64_t zigzag(int64_t val){
+    return (uint64_t(val) << 1) ^ uint64_t(val >> 63);
+}
+
+int64_t unzigzag(uint64_t val){
+    return int64_t(val >> 1) ^ -int64_t(val & 1);
+}
+
+static std::string type_name(Material *material){
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(typeid(*material).name(), nullptr, nullptr, &status);
+    std::string ans = status == 0 ? demangled : typeid(*material).name();
+    std::free(demangled);
+    return ans;
+}
+
+static int64_t quantize(double x){
+    return std::llround(x * path_log_scale);
+}
+
+static std::atomic<size_t> next_recorder_id(0);
+
+Path_recorder::Path_recorder(std::string name, std::vector<Body *> const &scene, size_t sample_period, size_t ring_capacity):
+    id(next_recorder_id++), sample_period(std::max<size_t>(1, sample_period)), ring_capacity(ring_capacity),
+    out(name, std::ios::binary), stop(false), dropped(0) {
+    std::unordered_map<Material *, size_t> material_id;
+    for (auto body : scene){
+        auto it = material_id.find(body->material);
+        if (it == material_id.end()){
+            it = material_id.emplace(body->material, material_names.size()).first;
+            material_names.push_back(type_name(body->material));
+        }
+        body_id[body] = body_names.size();
+        body_names.push_back(body->name);
+        body_material.push_back(it->second);
+    }
+
+    std::vector<uint8_t> buf(path_log_magic, path_log_magic + sizeof(path_log_magic));
+    for (int i=0; i<4; ++i){
+        buf.push_back(uint8_t(path_log_version >> (8*i)));
+    }
+    put_varint(buf, body_names.size());
+    for (size_t i=0; i<body_names.size(); ++i){
+        put_varint(buf, body_names[i].size());
+        buf.insert(buf.end(), body_names[i].begin(), body_names[i].end());
+        put_varint(buf, body_material[i]);
+    }
+    put_varint(buf, material_names.size());
+    for (auto &material_name : material_names){
+        put_varint(buf, material_name.size());
+        buf.insert(buf.end(), material_name.begin(), material_name.end());
+    }
+    out.write(reinterpret_cast<char *>(buf.data()), buf.size());
+
+    writer = std::thread(&Path_recorder::write_loop, this);
+}
+
+Path_recorder::~Path_recorder(){
+    stop = true;
+    writer.join();
+    out.close();
+}
+
+Path_recorder::Ring *Path_recorder::ring(){
+    // keyed by id rather than address, which a later recorder may reuse
+    thread_local Ring_lease lease;
+    if (lease.owner != id){
+        lease.release();
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        // A freed ring may still hold records; the writer drains them as usual
+        for (auto &r : rings){
+            bool expected = false;
+            if (r->taken.compare_exchange_strong(expected, true, std::memory_order_acquire)){
+                lease.ring = r;
+                break;
+            }
+        }
+        if (!lease.ring){
+            rings.push_back(std::make_shared<Ring>(ring_capacity));
+            lease.ring = rings.back();
+        }
+        lease.owner = id;
+    }
+    return lease.ring.get();
+}
+
+void Path_recorder::submit(Recorded_path const &path){
+    thread_local std::vector<uint8_t> buf;
+    buf.clear();
+
+    put_varint(buf, path.frame);
+    put_varint(buf, path.photon);
+    buf.push_back(path.exhausted ? 1 : 0);
+    put_varint(buf, path.vertices.size());
+    int64_t prev[3] = {0, 0, 0};
+    for (auto &vertex : path.vertices){
+        buf.push_back(vertex.kind);
+        auto it = vertex.body ? body_id.find(vertex.body) : body_id.end();
+        put_varint(buf, it == body_id.end() ? 0 : it->second + 1);
+
+        int64_t curr[3] = {quantize(vertex.pos.x), quantize(vertex.pos.y), quantize(vertex.pos.z)};
+        for (int i=0; i<3; ++i){
+            put_varint(buf, zigzag(curr[i] - prev[i]));
+            prev[i] = curr[i];
+        }
+    }
+
+    Ring *r = ring();
+    size_t cap = r->data.size();
+    size_t head = r->head.load(std::memory_order_relaxed);
+    size_t tail = r->tail.load(std::memory_order_acquire);
+    if (cap - (head - tail) < buf.size()){
+        ++dropped;
+        return;
+    }
+    size_t pos = head % cap;
+    size_t first = std::min(buf.size(), cap - pos);
+    std::memcpy(&r->data[pos], buf.data(), first);
+    std::memcpy(&r->data[0], buf.data() + first, buf.size() - first);
+    r->head.store(head + buf.size(), std::memory_order_release);
+}
+
+bool Path_recorder::drain(){
+    std::vector<Ring *> curr;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (auto &r : rings){
+            curr.push_back(r.get());
+        }
+    }
+
+    bool any = false;
+    for (auto r : curr){
+        size_t cap = r->data.size();
+        size_t tail = r->tail.load(std::memory_order_relaxed);
+        size_t head = r->head.load(std::memory_order_acquire);
+        if (head == tail){
+            continue;
+        }
+        // Records are written whole, so a drained range always ends on a record boundary.
+        size_t pos = tail % cap;
+        size_t amm = head - tail;
+        size_t first = std::min(amm, cap - pos);
+        out.write(reinterpret_cast<char *>(&r->data[pos]), first);
+        out.write(reinterpret_cast<char *>(&r->data[0]), amm - first);
+        r->tail.store(head, std::memory_order_release);
+        any = true;
+    }
+    return any;
+}
+
+void Path_recorder::write_loop(){
+    while (!stop){
+        if (!drain()){
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    drain();
+}
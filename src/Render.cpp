@@ -0,0 +1,170 @@
+#include "../include/Render.hpp"
+#include "../include/Light.hpp"
+#include "../include/Preview.hpp"
+#include "../include/Recorder.hpp"
+#include "../include/Wavefront.hpp"
+
+#include <fstream>
+#include <iostream>
+
+static unsigned int to_byte(double c){
+    if (c < 0)   c = 0;
+    if (c > 255) c = 255;
+    return std::lround(c);
+}
+
+void print_ppm(Pixel *pixels, int width, int height, std::string name){
+    std::ofstream out(name + ".ppm");
+    out << "P3" << " " << width << " " << height << " " << "255" << "\n";
+    for (int i_y=0; i_y<height; ++i_y){
+        for (int i_x=0; i_x<width; ++i_x){
+            Pixel curr = pixels[i_x + width * i_y];
+            out << to_byte(curr.r) << " " << to_byte(curr.g) << " " << to_byte(curr.b) << " \n";
+        }
+    }
+    out.close();
+}
+
+size_t pixel_index(Screen &screen, Vec_3d pos, size_t width, size_t height){
+    double rel_x = (-1.0 * ((pos - screen.pos) * screen.a) / screen.a.sqr() + 1.0) / 2.0;
+    double rel_y = ( 1.0 * ((pos - screen.pos) * screen.b) / screen.b.sqr() + 1.0) / 2.0;
+    size_t screen_x = rel_x * width;
+    size_t screen_y = rel_y * height;
+    return screen_x + width * screen_y;
+}
+
+void print_progress(size_t i, size_t ray_amm, size_t hit_count, size_t *itr_counter, size_t max_itr){
+    std::cout << 100.0 * i/ray_amm << "%" << "\n";
+    std::cout << i << "\n";
+    std::cout << hit_count << "\n";
+    std::cout << 1.0 * hit_count/i << "\n";
+    std::cout << "\n";
+    for(size_t i=0; i<max_itr; ++i){
+        std::cout << i+1 << ":  " << itr_counter[i] << "\n";
+    }
+    std::cout << "\n\n";
+}
+
+size_t render_frame(Render_settings const &settings, Bvh &bvh, Light_sampler &lights, Screen screen, Pixel *pixels, Aux_pixel *aux, size_t *itr_counter){
+    if (lights.empty()){
+        std::cerr << "render: the scene has no lights\n";
+        return 0;
+    }
+    if (settings.wavefront){
+        Wavefront wavefront(settings, bvh, lights, screen, pixels, aux, itr_counter);
+        return wavefront.render();
+    }
+    if (settings.preview){
+        settings.preview->publish(pixels, 0, 0, settings.frame);
+    }
+
+    size_t width = settings.width, height = settings.height;
+    size_t max_itr = settings.max_itr;
+    size_t ray_amm = settings.ray_amm;
+    double eps = settings.eps;
+    size_t hit_count = 0;
+    Recorded_path recorded;
+    Rng &rng = thread_rng();
+
+    for (size_t i=1; i<=ray_amm; ++i){
+        Photon photon = lights.emit(rng);
+
+        Recorded_path *record = nullptr;
+        if (settings.recorder && settings.recorder->sample(i)){
+            record = &recorded;
+            record->begin(settings.frame, i, photon.pos);
+        }
+        // Off the emitting surface
+        photon.pos += eps * photon.dir;
+
+        Path_guide guide;
+        size_t itr = 0;
+        while (photon.alive && itr < max_itr) {
+            ++itr;
+
+            double screen_dist = screen.dist(photon);
+
+            Intersection_point closest_inter;
+            Body *closest_body = bvh.get_intersection(photon, closest_inter);
+
+            double fog_dist = std::numeric_limits<double>::infinity();
+            if (settings.fog_present){
+                fog_dist = -1.0 * std::log(rand_uns(0, 1.0)) / settings.fog_coef;
+            }
+
+            double min_dist = std::numeric_limits<double>::infinity();
+            Photon_event event = Photon_event::stray;
+            if (min_dist > screen_dist){
+                min_dist = screen_dist;
+                event = Photon_event::screen;
+            }
+            if (min_dist > closest_inter.dist){
+                min_dist = closest_inter.dist;
+                event = Photon_event::object;
+            }
+            if (min_dist > fog_dist){
+                min_dist = fog_dist;
+                event = Photon_event::fog;
+            }
+
+            if(event == Photon_event::stray){
+                photon.alive = false;
+                if (record){
+                    record->add(photon.pos, event, nullptr);
+                }
+            }else if(event == Photon_event::screen){
+                photon.pos += screen_dist * photon.dir;
+                guide.advance(screen_dist);
+
+                size_t ind = pixel_index(screen, photon.pos, width, height);
+                pixels[ind].add(spectrum_to_rgb(photon.wl));
+                if (aux){
+                    aux[ind].add(guide);
+                }
+
+                ++hit_count;
+                photon.alive = false;
+                if (record){
+                    record->add(photon.pos, event, nullptr);
+                }
+            }else if (event == Photon_event::object){
+                photon.pos = closest_inter.pos;
+                if (record){
+                    record->add(photon.pos, event, closest_body);
+                }
+                Vec_3d normal = closest_body->get_normal(closest_inter);
+                closest_body->interact(photon, normal);
+                photon.pos += eps * photon.dir;
+                guide.advance(closest_inter.dist);
+                guide.vertex(closest_body, normal);
+            }else if (event == Photon_event::fog){
+                photon.pos += photon.dir * fog_dist;
+                photon.dir = rand_unit_vec();
+                guide.scatter();
+                if (record){
+                    record->add(photon.pos, event, nullptr);
+                }
+                //photon.alive = false;
+            }
+        }
+        ++itr_counter[itr-1];
+        if (record){
+            record->exhausted = photon.alive;
+            settings.recorder->submit(*record);
+        }
+        if (i%100000 == 0){
+            print_progress(i, ray_amm, hit_count, itr_counter, max_itr);
+            if (settings.preview){
+                settings.preview->publish(pixels, i, hit_count, settings.frame);
+            }
+        }
+//        if (i%(10 * ray_amm/100) == 0){
+//            print_ppm(pixels, width, height, "pic");// + std::to_string(i/(ray_amm/100)));
+//        }
+    }
+    if (settings.preview){
+        settings.preview->publish(pixels, ray_amm, hit_count, settings.frame);
+    }
+    return hit_count;
+}
+
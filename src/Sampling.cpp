@@ -0,0 +1,152 @@
+#include "../include/Sampling.hpp"
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+static uint64_t splitmix(uint64_t &x){
+    uint64_t z = (x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+Rng::Rng(uint64_t seed){
+    for (int i=0; i<4; ++i){
+        s[i] = splitmix(seed);
+    }
+}
+
+Rng &thread_rng(){
+    thread_local Rng rng(std::chrono::steady_clock::now().time_since_epoch().count() ^
+                         std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return rng;
+}
+
+namespace {
+
+struct Uniforms{
+    std::vector<double> u_1, u_2;
+
+    void fill(Rng &rng, size_t amm){
+        u_1.resize(amm);
+        u_2.resize(amm);
+        for (size_t i=0; i<amm; ++i){
+            u_1[i] = rng.uniform();
+            u_2[i] = rng.uniform();
+        }
+    };
+};
+
+// cos_theta holds the polar cosines on input; the loop has no calls or
+// branches left after inlining. The omp simd loops here vectorize under the
+// project's -fopenmp-simd, with -fno-math-errno letting sqrt inline.
+void finish(Uniforms const &u, std::vector<double> const &cos_theta, Onb const &onb, Dir_batch &ans){
+    size_t amm = cos_theta.size();
+    ans.resize(amm);
+    const double *__restrict ct_in = cos_theta.data();
+    const double *__restrict u_2 = u.u_2.data();
+    double *__restrict x_out = ans.x.data();
+    double *__restrict y_out = ans.y.data();
+    double *__restrict z_out = ans.z.data();
+    const Vec_3d t = onb.t, b = onb.b, n = onb.n;
+
+    #pragma omp simd
+    for (size_t i=0; i<amm; ++i){
+        double ct = ct_in[i];
+        double st = std::sqrt(std::max(0.0, 1 - ct*ct));
+        double s, c;
+        sincos_2pi(u_2[i], s, c);
+        double x = st * c, y = st * s;
+        x_out[i] = x*t.x + y*b.x + ct*n.x;
+        y_out[i] = x*t.y + y*b.y + ct*n.y;
+        z_out[i] = x*t.z + y*b.z + ct*n.z;
+    }
+}
+
+thread_local Uniforms uniforms;
+thread_local std::vector<double> cos_buf;
+
+}
+
+void sample_uniform_sphere(Rng &rng, size_t amm, Dir_batch &ans){
+    Uniforms &u = uniforms;
+    std::vector<double> &cos_theta = cos_buf;
+    u.fill(rng, amm);
+    cos_theta.resize(amm);
+    #pragma omp simd
+    for (size_t i=0; i<amm; ++i){
+        cos_theta[i] = 1 - 2*u.u_1[i];
+    }
+    finish(u, cos_theta, Onb(Vec_3d(0, 0, 1)), ans);
+}
+
+void sample_cone(Rng &rng, size_t amm, Onb const &onb, double cos_max, Dir_batch &ans){
+    Uniforms &u = uniforms;
+    std::vector<double> &cos_theta = cos_buf;
+    u.fill(rng, amm);
+    cos_theta.resize(amm);
+    #pragma omp simd
+    for (size_t i=0; i<amm; ++i){
+        cos_theta[i] = 1 - u.u_1[i] * (1 - cos_max);
+    }
+    finish(u, cos_theta, onb, ans);
+}
+
+void sample_cosine(Rng &rng, size_t amm, Onb const &onb, Dir_batch &ans){
+    Uniforms &u = uniforms;
+    std::vector<double> &cos_theta = cos_buf;
+    u.fill(rng, amm);
+    cos_theta.resize(amm);
+    #pragma omp simd
+    for (size_t i=0; i<amm; ++i){
+        cos_theta[i] = std::sqrt(1 - u.u_1[i]);
+    }
+    finish(u, cos_theta, onb, ans);
+}
+
+void sample_cos_power(Rng &rng, size_t amm, Onb const &onb, double pow_index, Dir_batch &ans){
+    Uniforms &u = uniforms;
+    std::vector<double> &cos_theta = cos_buf;
+    u.fill(rng, amm);
+    cos_theta.resize(amm);
+    double inv_exp = 1 / (2 + pow_index);
+    for (size_t i=0; i<amm; ++i){
+        cos_theta[i] = std::pow(1 - u.u_1[i], inv_exp);
+    }
+    finish(u, cos_theta, onb, ans);
+}
+
+Alias_table::Alias_table(std::vector<double> const &weights): prob(weights.size(), 1.0), alias(weights.size()) {
+    size_t n = weights.size();
+    double total = 0;
+    for (auto w : weights){
+        total += w;
+    }
+
+    // Columns below the mean are topped up from one above it, which keeps the rest
+    std::vector<double> scaled(n);
+    std::vector<size_t> small, large;
+    for (size_t i=0; i<n; ++i){
+        scaled[i] = weights[i] * n / total;
+        alias[i] = i;
+        if (scaled[i] < 1){
+            small.push_back(i);
+        }else{
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty()){
+        size_t s = small.back();
+        size_t l = large.back();
+        small.pop_back();
+        prob[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1){
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is full up to rounding and keeps prob 1
+}
@@ -1,24 +1,25 @@
+#include "../include/Csg.hpp"
 #include "../include/Scene.hpp"
 
-Shape_base *make_lens(Vec_3d pos, Vec_3d dir, double r_1, double r_2, double r_size){
+Shape_base *make_lens(Arena &arena, Vec_3d pos, Vec_3d dir, double r_1, double r_2, double r_size){
     dir /= dir.len();
     double dist_1 = std::sqrt(sqr(r_1) - sqr(r_size));
     double dist_2 = std::sqrt(sqr(r_2) - sqr(r_size));
-    Shape_ball *ball_1 = new Shape_ball(pos - dist_1 * dir, r_1);
-    Shape_ball *ball_2 = new Shape_ball(pos + dist_2 * dir, r_2);
-    Shape_intersection *inter_1 = new Shape_intersection(ball_1, ball_2);
+    Shape_ball *ball_1 = arena.make<Shape_ball>(pos - dist_1 * dir, r_1);
+    Shape_ball *ball_2 = arena.make<Shape_ball>(pos + dist_2 * dir, r_2);
+    Shape_intersection *inter_1 = arena.make<Shape_intersection>(ball_1, ball_2);
     return inter_1;
 }
 
-std::vector<Body *> init_scene_1(){
-    Shape_base *lens_1 = make_lens(Vec_3d(0, -6, 0), Vec_3d(0, 1, 0), 9, 9, 3);
-    Body *body_1 = new Body(lens_1, new Refracting(2.5), "lens_1");
+std::vector<Body *> init_scene_1(Arena &arena){
+    Shape_base *lens_1 = make_lens(arena, Vec_3d(0, -6, 0), Vec_3d(0, 1, 0), 9, 9, 3);
+    Body *body_1 = arena.make<Body>(lens_1, arena.make<Refracting>(arena.make<Dispersion_cauchy>(2.45, 0.015)), "lens_1");
 
-    Shape_base *lens_2 = make_lens(Vec_3d(0,  6, 0), Vec_3d(0, 1, 0), 9, 9, 3);
-    Body *body_2 = new Body(lens_2, new Refracting(2.5), "lens_2");
+    Shape_base *lens_2 = make_lens(arena, Vec_3d(0,  6, 0), Vec_3d(0, 1, 0), 9, 9, 3);
+    Body *body_2 = arena.make<Body>(lens_2, arena.make<Refracting>(arena.make<Dispersion_cauchy>(2.45, 0.015)), "lens_2");
 
-    Shape_base *plane_1 = new Shape_plane(Vec_3d(0, 12, 0), Vec_3d(0, 1, 0));
-    Body *body_3 = new Body(plane_1, new Lambertian, "surf");
+    Shape_base *plane_1 = arena.make<Shape_plane>(Vec_3d(0, 12, 0), Vec_3d(0, 1, 0));
+    Body *body_3 = arena.make<Body>(plane_1, arena.make<Lambertian>(), "surf");
 
     std::vector<Body *> scene;
     scene.push_back(body_1);
@@ -27,25 +28,25 @@ std::vector<Body *> init_scene_1(){
     return scene;
 }
 
-std::vector<Body *> init_scene_2(){
+std::vector<Body *> init_scene_2(Arena &arena){
     double pow_index = 0.5;
 
-    Shape_plane *plane_0 = new Shape_plane(Vec_3d(0, 0, 0), Vec_3d(0, 0, -1));
-    Body *body_0 = new Body(plane_0, new Lambertian, "surf");
+    Shape_plane *plane_0 = arena.make<Shape_plane>(Vec_3d(0, 0, 0), Vec_3d(0, 0, -1));
+    Body *body_0 = arena.make<Body>(plane_0, arena.make<Lambertian>(), "surf");
 
-    Shape_ball *ball_1 = new Shape_ball(Vec_3d(-2, -2, 1), 2);
-    Body *body_1 = new Body(ball_1, new Lambertian_cos(pow_index), "ball_1");
+    Shape_ball *ball_1 = arena.make<Shape_ball>(Vec_3d(-2, -2, 1), 2);
+    Body *body_1 = arena.make<Body>(ball_1, arena.make<Lambertian_cos>(pow_index), "ball_1");
 
-    Shape_ball *ball_2 = new Shape_ball(Vec_3d(-2, +2, 1), 2);
-    Body *body_2 = new Body(ball_2, new Lambertian_cos(pow_index), "ball_2");
+    Shape_ball *ball_2 = arena.make<Shape_ball>(Vec_3d(-2, +2, 1), 2);
+    Body *body_2 = arena.make<Body>(ball_2, arena.make<Lambertian_cos>(pow_index), "ball_2");
 
-    Shape_ball *ball_3 = new Shape_ball(Vec_3d(0, 0, 9), 2);
-    Body *body_3 = new Body(ball_3, new Lambertian_cos(pow_index), "ball_3");
+    Shape_ball *ball_3 = arena.make<Shape_ball>(Vec_3d(0, 0, 9), 2);
+    Body *body_3 = arena.make<Body>(ball_3, arena.make<Lambertian_cos>(pow_index), "ball_3");
 
-    Shape_cylinder  *cylinder_1 = new Shape_cylinder(Vec_3d(    0, 0.0, 0.0), Vec_3d(0, 0, 1), 2);
-    Shape_plane        *plane_1 = new Shape_plane(Vec_3d(0, 0, 9), Vec_3d(0, 0, 1));
-    Shape_intersection *inter_1 = new Shape_intersection(cylinder_1, plane_1);
-    Body *body_4 = new Body(inter_1, new Lambertian_cos(pow_index), "cyl");
+    Shape_cylinder  *cylinder_1 = arena.make<Shape_cylinder>(Vec_3d(    0, 0.0, 0.0), Vec_3d(0, 0, 1), 2);
+    Shape_plane        *plane_1 = arena.make<Shape_plane>(Vec_3d(0, 0, 9), Vec_3d(0, 0, 1));
+    Shape_intersection *inter_1 = arena.make<Shape_intersection>(cylinder_1, plane_1);
+    Body *body_4 = arena.make<Body>(inter_1, arena.make<Lambertian_cos>(pow_index), "cyl");
 
     std::vector<Body *> scene;
     scene.push_back(body_0);
@@ -56,33 +57,25 @@ std::vector<Body *> init_scene_2(){
     return scene;
 }
 
-std::vector<Body *> init_scene_3(){
-    Shape_plane *plane_0 = new Shape_plane(Vec_3d(0, 0, 0), Vec_3d(0, 0, -1));
-    Body *body_0 = new Body(plane_0, new Lambertian, "surf");
+std::vector<Body *> init_scene_3(Arena &arena){
+    Shape_plane *plane_0 = arena.make<Shape_plane>(Vec_3d(0, 0, 0), Vec_3d(0, 0, -1));
+    Body *body_0 = arena.make<Body>(plane_0, arena.make<Lambertian>(), "surf");
 
-    Shape_plane *plane_1 = new Shape_plane(Vec_3d( 0,  0,  8), Vec_3d( 0,  0, -1));
-    Shape_plane *plane_2 = new Shape_plane(Vec_3d( 0,  0, 12), Vec_3d( 0,  0, +1));
-    Shape_plane *plane_3 = new Shape_plane(Vec_3d(+2,  0, 10), Vec_3d(+1,  0,  0));
-    Shape_plane *plane_4 = new Shape_plane(Vec_3d(-2,  0, 10), Vec_3d(-1,  0,  0));
-    Shape_plane *plane_5 = new Shape_plane(Vec_3d( 0, +2, 10), Vec_3d( 0, +1,  0));
-    Shape_plane *plane_6 = new Shape_plane(Vec_3d( 0, -2, 10), Vec_3d( 0, -1,  0));
+    // Fixed cube with a ball cut out of its corner, specialized at compile time
+    auto cube_1 = intersect(intersect(csg_plane(Vec_3d( 0,  0,  8), Vec_3d( 0,  0, -1)),
+                                      csg_plane(Vec_3d( 0,  0, 12), Vec_3d( 0,  0, +1))),
+                  intersect(intersect(csg_plane(Vec_3d(+2,  0, 10), Vec_3d(+1,  0,  0)),
+                                      csg_plane(Vec_3d(-2,  0, 10), Vec_3d(-1,  0,  0))),
+                            intersect(csg_plane(Vec_3d( 0, +2, 10), Vec_3d( 0, +1,  0)),
+                                      csg_plane(Vec_3d( 0, -2, 10), Vec_3d( 0, -1,  0)))));
 
-    Shape_intersection *inter_1 = new Shape_intersection(plane_1, plane_2);
-    Shape_intersection *inter_2 = new Shape_intersection(plane_3, plane_4);
-    Shape_intersection *inter_3 = new Shape_intersection(plane_5, plane_6);
-    Shape_intersection *inter_4 = new Shape_intersection(inter_1, inter_2);
-    Shape_intersection *cube_1  = new Shape_intersection(inter_3, inter_4);
+    Shape_base *inter_5 = make_static_shape(arena, intersect(cube_1, invert(csg_ball(Vec_3d(-2, 2, 12), 2))));
 
-    Shape_ball *ball_1 = new Shape_ball(Vec_3d(-2, 2, 12), 2);
-    Shape_inversion *inv_1 = new Shape_inversion(ball_1);
+    Body *body_1 = arena.make<Body>(inter_5, arena.make<Lambertian>(), "body_1");
 
-    Shape_intersection *inter_5 = new Shape_intersection(cube_1, inv_1);
+    Shape_cylinder *cyl_1 = arena.make<Shape_cylinder>(Vec_3d(-8, -10, 0), Vec_3d(0, 0, 1), 4);
 
-    Body *body_1 = new Body(inter_5, new Lambertian, "body_1");
-
-    Shape_cylinder *cyl_1 = new Shape_cylinder(Vec_3d(-8, -10, 0), Vec_3d(0, 0, 1), 4);
-
-    Body *body_2 = new Body(cyl_1, new Reflecting, "cyl_1");
+    Body *body_2 = arena.make<Body>(cyl_1, arena.make<Reflecting>(), "cyl_1");
 
     std::vector<Body *> scene;
     scene.push_back(body_0);
@@ -91,7 +84,32 @@ std::vector<Body *> init_scene_3(){
     return scene;
 }
 
-std::pair<Screen, Body *> make_camera(Vec_3d center, Vec_3d dir, double focus){
+// Scene 3 under a wide ceiling of small lamps of uneven power, most of them
+// far from what the camera sees.
+std::vector<Body *> init_scene_4(Arena &arena){
+    std::vector<Body *> scene = init_scene_3(arena);
+
+    size_t lamp_amm = 16;
+    double spacing = 8;
+    for (size_t i=0; i<lamp_amm; ++i){
+        for (size_t j=0; j<lamp_amm; ++j){
+            Vec_3d pos((i - 0.5*(lamp_amm-1)) * spacing, (j - 0.5*(lamp_amm-1)) * spacing, 20);
+            double power = 0.01 * (1 + (3*i + 5*j) % 4);
+            Shape_ball *lamp = arena.make<Shape_ball>(pos, 0.5);
+            scene.push_back(arena.make<Body>(lamp, arena.make<Emissive>(power), "lamp_" + std::to_string(i*lamp_amm + j)));
+        }
+    }
+    return scene;
+}
+
+// The spot light the scenes were made for, plus every emissive body
+std::vector<Light_base *> init_lights(Arena &arena, std::vector<Body *> const &scene){
+    std::vector<Light_base *> lights = emissive_lights(arena, scene);
+    lights.push_back(arena.make<Light_cone>(Vec_3d(-10, 5, 25), Vec_3d(10, -5, -15), std::acos(0)/8, 1.0));
+    return lights;
+}
+
+std::pair<Screen, Body *> make_camera(Arena &arena, Vec_3d center, Vec_3d dir, double focus){
     dir /= dir.len();
     double r_1 = 15;
     double r_2 = 15;
@@ -99,8 +117,8 @@ std::pair<Screen, Body *> make_camera(Vec_3d center, Vec_3d dir, double focus){
     double focal_dist = 1 / ((refr_ind - 1) * (1/r_1 + 1/r_2));
     double lens_dist = (focus - std::sqrt(sqr(focus) - 4*focus*focal_dist)) / 2;
 
-    Shape_base *lens_shape = make_lens(center + lens_dist * dir, dir, r_1, r_2, 4);
-    Body *lens_1 = new Body(lens_shape, new Refracting(2.5), "lens_1");
+    Shape_base *lens_shape = make_lens(arena, center + lens_dist * dir, dir, r_1, r_2, 4);
+    Body *lens_1 = arena.make<Body>(lens_shape, arena.make<Refracting>(2.5), "lens_1");
 
     double screen_width  = 3;
     double screen_height = 3;
@@ -120,10 +138,37 @@ std::pair<Screen, Body *> make_camera(Vec_3d center, Vec_3d dir, double focus){
     return std::make_pair(screen, lens_1);
 }
 
-Photon source(Vec_3d pos, double r){
-    return Photon(pos + rand_unit_vec() * r);
+// Rigid motion taking the camera built by make_camera at ref to curr.
+// The focus distance stays the one of ref.
+Transform camera_transform(Camera_keyframe const &ref, Camera_keyframe const &curr){
+    Transform from = Transform::look_at(ref.pos, ref.targ - ref.pos);
+    Transform to   = Transform::look_at(curr.pos, curr.targ - curr.pos);
+    return to * from.inverse();
+}
+
+static Body *find_body(std::vector<Body *> &scene, std::string name){
+    for (auto body : scene){
+        if (body->name == name){
+            return body;
+        }
+    }
+    return nullptr;
 }
 
-Photon cone_source (Vec_3d pos, Vec_3d dir, double theta_max){
-    return Photon(pos, rand_unit_segment(dir, theta_max));
+Animation init_animation_3(std::vector<Body *> &scene, Camera_keyframe const &ref){
+    Animation animation;
+
+    Vec_3d orbit = ref.pos - ref.targ;
+    for (int i=0; i<=4; ++i){
+        double angle = i * std::acos(0) / 4;
+        Vec_3d pos = ref.targ + rotate_a_to_b(Vec_3d(1, 0, 0), Vec_3d(std::cos(angle), std::sin(angle), 0), orbit);
+        animation.camera.add(Camera_keyframe{i / 4.0, pos, ref.targ});
+    }
+
+    Track cyl_track;
+    cyl_track.add(Keyframe{0.0, Vec_3d(0, 0, 0), Vec_3d(0, 0, 0)});
+    cyl_track.add(Keyframe{1.0, Vec_3d(4, 4, 0), Vec_3d(0, 0, 0)});
+    animation.bodies.push_back(std::make_pair(find_body(scene, "cyl_1"), cyl_track));
+
+    return animation;
 }
@@ -0,0 +1,55 @@
+#include "../include/Spectrum.hpp"
+#include "../include/Vec_3d.hpp"
+
+Wavelengths rand_wavelengths(){
+    const double range = lambda_max - lambda_min;
+
+    Wavelengths wl;
+    double hero = rand_uns(0, range);
+    for (size_t i=0; i<Wavelengths::count; ++i){
+        wl.lambda[i] = lambda_min + std::fmod(hero + i*range/Wavelengths::count, range);
+        wl.weight[i] = 1.0;
+    }
+    return wl;
+}
+
+// Multi-lobe fit of the CIE 1931 matching functions (Wyman, Sloan, Shirley 2013).
+static double lobe(double lambda, double mu, double sigma_1, double sigma_2){
+    double t = (lambda - mu) / (lambda < mu ? sigma_1 : sigma_2);
+    return std::exp(-0.5 * t * t);
+}
+
+double cie_x(double lambda){
+    return 1.056 * lobe(lambda, 599.8, 37.9, 31.0)
+         + 0.362 * lobe(lambda, 442.0, 16.0, 26.7)
+         - 0.065 * lobe(lambda, 501.1, 20.4, 26.2);
+}
+
+double cie_y(double lambda){
+    return 0.821 * lobe(lambda, 568.8, 46.9, 40.5)
+         + 0.286 * lobe(lambda, 530.9, 16.3, 31.1);
+}
+
+double cie_z(double lambda){
+    return 1.217 * lobe(lambda, 437.0, 11.8, 36.0)
+         + 0.681 * lobe(lambda, 459.0, 26.0, 13.8);
+}
+
+Vec_3d spectrum_to_rgb(Wavelengths const &wl){
+    // Integral of cie_y over [lambda_min, lambda_max]: an equal-energy photon gives Y = 1.
+    const double y_integral = 106.92;
+    const double norm = (lambda_max - lambda_min) / (Wavelengths::count * y_integral);
+
+    double x = 0, y = 0, z = 0;
+    for (size_t i=0; i<Wavelengths::count; ++i){
+        double w = wl.weight[i] * norm;
+        x += w * cie_x(wl.lambda[i]);
+        y += w * cie_y(wl.lambda[i]);
+        z += w * cie_z(wl.lambda[i]);
+    }
+
+    // XYZ to linear sRGB
+    return Vec_3d( 3.2406*x - 1.5372*y - 0.4986*z,
+                  -0.9689*x + 1.8758*y + 0.0415*z,
+                   0.0557*x - 0.2040*y + 1.0570*z);
+}
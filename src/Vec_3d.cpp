@@ -1,4 +1,5 @@
 #include "../include/Vec_3d.hpp"
+#include "../include/Sampling.hpp"
 
 Vec_3d rotate_a_to_b(Vec_3d a, Vec_3d b, Vec_3d p){
     const double cos_min = 1E-9 - 1.0;
@@ -20,34 +21,18 @@ Vec_3d rotate_a_to_b(Vec_3d a, Vec_3d b, Vec_3d p){
 }
 
 double rand_uns(double min, double max) {
-    static unsigned seed = std::chrono::steady_clock::now().time_since_epoch().count();
-    static std::default_random_engine e(seed);
-    std::uniform_real_distribution<double> d(min, max);
-    return d(e);
+    return min + (max - min) * thread_rng().uniform();
 }
 
 Vec_3d rand_unit_vec(){
-    double phi = rand_uns(0, 4*std::acos(0));
-    double cos_phi = std::cos(phi);
-    double sin_phi = std::sin(phi);
-
-    double cos_theta = rand_uns(-1, 1);
-    double sin_theta = std::sqrt(1 - sqr(cos_theta));
-
-    Vec_3d ans(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
-    return ans;
+    Rng &rng = thread_rng();
+    double u_1 = rng.uniform();
+    return sample_uniform_sphere(u_1, rng.uniform());
 }
 
 Vec_3d rand_unit_segment(Vec_3d axis, double theta_max){
-    double phi = rand_uns(0, 4*std::acos(0));
-    double cos_phi = std::cos(phi);
-    double sin_phi = std::sin(phi);
-
-    double cos_theta = rand_uns(std::cos(theta_max), 1);
-    double sin_theta = std::sqrt(1 - sqr(cos_theta));
-
-    Vec_3d deviation(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
-    Vec_3d ans = rotate_a_to_b(Vec_3d(0, 0, 1), axis, deviation);
-
-    return ans;
+    Rng &rng = thread_rng();
+    double u_1 = rng.uniform();
+    Vec_3d deviation = sample_cone(u_1, rng.uniform(), std::cos(theta_max));
+    return Onb(axis / axis.len()).to_world(deviation);
 }
@@ -0,0 +1,286 @@
+#include "../include/Wavefront.hpp"
+#include "../include/Preview.hpp"
+#include "../include/Sampling.hpp"
+
+#include <thread>
+
+Wavefront::Wavefront(Render_settings const &settings, Bvh &bvh, Light_sampler &lights, Screen screen, Pixel *pixels, Aux_pixel *aux, size_t *itr_counter):
+    settings(settings), bvh(bvh), lights(lights), screen(screen), pixels(pixels), aux(aux), itr_counter(itr_counter), launched(0), hit_count(0) {
+};
+
+size_t Wavefront::render(){
+    size_t thread_amm = std::max<size_t>(1, settings.thread_amm);
+    size_t capacity = std::max<size_t>(1, settings.pool_size);
+
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<thread_amm; ++i){
+        threads.emplace_back([this, capacity](){
+            Pool(*this, capacity).run();
+        });
+    }
+    Pool(*this, capacity).run();
+    for (auto &thread : threads){
+        thread.join();
+    }
+
+    if (settings.preview){
+        settings.preview->publish(pixels, settings.ray_amm, hit_count, settings.frame);
+    }
+    return hit_count;
+}
+
+size_t Wavefront::claim(size_t amm, size_t &first){
+    first = launched.fetch_add(amm);
+    if (first >= settings.ray_amm){
+        return 0;
+    }
+    size_t got = std::min(amm, settings.ray_amm - first);
+
+    if ((first + got) / 100000 != first / 100000){
+        std::lock_guard<std::mutex> lock(mutex);
+        print_progress(first + got, settings.ray_amm, hit_count, itr_counter, settings.max_itr);
+        if (settings.preview){
+            settings.preview->publish(pixels, first + got, hit_count, settings.frame);
+        }
+    }
+    return got;
+}
+
+Wavefront::Pool::Pool(Wavefront &wf, size_t capacity):
+    wf(wf), photon(capacity), itr(capacity), dist(capacity), inter(capacity), body(capacity),
+    guide(capacity), record(capacity, nullptr), in_flight(capacity, 0), itr_counter(wf.settings.max_itr, 0) {
+    active.reserve(capacity);
+    order.reserve(capacity);
+    free_slots.reserve(capacity);
+    for (size_t s=capacity; s-->0;){
+        free_slots.push_back(s);
+    }
+};
+
+void Wavefront::Pool::run(){
+    generate();
+    gather();
+    while (!active.empty()){
+        intersect();
+        sort();
+
+        for (size_t k=0; k+1<key_begin.size(); ++k){
+            size_t begin = key_begin[k], end = key_begin[k+1];
+            if (begin == end){
+                continue;
+            }
+            if (k == key_stray){
+                kill(begin, end);
+            }else if (k == key_screen){
+                splat(begin, end);
+            }else if (k == key_fog){
+                scatter_fog(begin, end);
+            }else{
+                shade(wf.bvh.get_materials()[k - key_object], begin, end);
+            }
+        }
+
+        compact();
+        flush();
+        generate();
+        gather();
+    }
+    flush();
+}
+
+void Wavefront::Pool::generate(){
+    size_t first = 0;
+    size_t amm = wf.claim(free_slots.size(), first);
+    if (amm == 0){
+        return;
+    }
+    emitted.clear();
+    wf.lights.emit(thread_rng(), amm, emitted);
+
+    Path_recorder *recorder = wf.settings.recorder;
+    for (size_t j=0; j<amm; ++j){
+        size_t s = free_slots.back();
+        free_slots.pop_back();
+
+        photon[s] = emitted[j];
+        record[s] = nullptr;
+        if (recorder && recorder->sample(first + j + 1)){
+            record[s] = new Recorded_path();
+            record[s]->begin(wf.settings.frame, first + j + 1, photon[s].pos);
+        }
+        // Off the emitting surface
+        photon[s].pos += wf.settings.eps * photon[s].dir;
+        itr[s] = 0;
+        guide[s] = Path_guide();
+        in_flight[s] = 1;
+    }
+}
+
+void Wavefront::Pool::intersect(){
+    size_t amm = active.size();
+    screen_dist.resize(amm);
+    object_dist.resize(amm);
+    fog_dist.resize(amm);
+    event_dist.resize(amm);
+    key.resize(amm);
+
+    for (size_t i=0; i<amm; ++i){
+        size_t s = active[i];
+        ++itr[s];
+        screen_dist[i] = wf.screen.dist(photon[s]);
+        inter[s] = Intersection_point();
+        body[s] = wf.bvh.get_intersection(photon[s], inter[s]);
+        object_dist[i] = inter[s].dist;
+    }
+
+    if (wf.settings.fog_present){
+        Rng &rng = thread_rng();
+        double coef = wf.settings.fog_coef;
+        for (size_t i=0; i<amm; ++i){
+            fog_dist[i] = -1.0 * std::log(1 - rng.uniform()) / coef;
+        }
+    }else{
+        std::fill(fog_dist.begin(), fog_dist.end(), std::numeric_limits<double>::infinity());
+    }
+
+    // Nearest event, branch free over contiguous arrays
+    const double *__restrict d_screen = screen_dist.data();
+    const double *__restrict d_object = object_dist.data();
+    const double *__restrict d_fog = fog_dist.data();
+    double *__restrict d_event = event_dist.data();
+    size_t *__restrict k_event = key.data();
+    for (size_t i=0; i<amm; ++i){
+        double d = std::numeric_limits<double>::infinity();
+        size_t k = key_stray;
+        k = d_screen[i] < d ? key_screen : k;
+        d = std::min(d, d_screen[i]);
+        k = d_object[i] < d ? key_object : k;
+        d = std::min(d, d_object[i]);
+        k = d_fog[i] < d ? key_fog : k;
+        d = std::min(d, d_fog[i]);
+        d_event[i] = d;
+        k_event[i] = k;
+    }
+
+    for (size_t i=0; i<amm; ++i){
+        size_t s = active[i];
+        dist[s] = event_dist[i];
+        if (key[i] == key_object){
+            key[i] += body[s]->material_ind;
+        }
+    }
+}
+
+// Counting sort of the slots by key; key_begin[k] is the first with key k.
+void Wavefront::Pool::sort(){
+    key_begin.assign(key_object + wf.bvh.get_materials().size() + 1, 0);
+    for (auto k : key){
+        ++key_begin[k + 1];
+    }
+    for (size_t k=1; k<key_begin.size(); ++k){
+        key_begin[k] += key_begin[k-1];
+    }
+
+    key_next.assign(key_begin.begin(), key_begin.end() - 1);
+    order.resize(active.size());
+    for (size_t i=0; i<active.size(); ++i){
+        order[key_next[key[i]]++] = active[i];
+    }
+}
+
+void Wavefront::Pool::kill(size_t begin, size_t end){
+    for (size_t i=begin; i<end; ++i){
+        size_t s = order[i];
+        photon[s].alive = false;
+        if (record[s]){
+            record[s]->add(photon[s].pos, Photon_event::stray, nullptr);
+        }
+    }
+}
+
+void Wavefront::Pool::splat(size_t begin, size_t end){
+    size_t width = wf.settings.width, height = wf.settings.height;
+    for (size_t i=begin; i<end; ++i){
+        size_t s = order[i];
+        photon[s].pos += dist[s] * photon[s].dir;
+        guide[s].advance(dist[s]);
+
+        size_t ind = pixel_index(wf.screen, photon[s].pos, width, height);
+        splats.push_back(Splat{ind, spectrum_to_rgb(photon[s].wl), guide[s]});
+
+        photon[s].alive = false;
+        if (record[s]){
+            record[s]->add(photon[s].pos, Photon_event::screen, nullptr);
+        }
+    }
+}
+
+void Wavefront::Pool::shade(Material *material, size_t begin, size_t end){
+    double eps = wf.settings.eps;
+    for (size_t i=begin; i<end; ++i){
+        size_t s = order[i];
+        photon[s].pos = inter[s].pos;
+        if (record[s]){
+            record[s]->add(photon[s].pos, Photon_event::object, body[s]);
+        }
+        Vec_3d normal = body[s]->get_normal(inter[s]);
+        material->interact(photon[s], normal);
+        photon[s].pos += eps * photon[s].dir;
+        guide[s].advance(dist[s]);
+        guide[s].vertex(body[s], normal);
+    }
+}
+
+void Wavefront::Pool::scatter_fog(size_t begin, size_t end){
+    for (size_t i=begin; i<end; ++i){
+        size_t s = order[i];
+        photon[s].pos += photon[s].dir * dist[s];
+        photon[s].dir = rand_unit_vec();
+        guide[s].scatter();
+        if (record[s]){
+            record[s]->add(photon[s].pos, Photon_event::fog, nullptr);
+        }
+    }
+}
+
+// Retires finished paths and frees their slots.
+void Wavefront::Pool::compact(){
+    for (auto s : order){
+        if (!photon[s].alive || itr[s] >= wf.settings.max_itr){
+            ++itr_counter[itr[s]-1];
+            if (record[s]){
+                record[s]->exhausted = photon[s].alive;
+                wf.settings.recorder->submit(*record[s]);
+                delete record[s];
+                record[s] = nullptr;
+            }
+            in_flight[s] = 0;
+            free_slots.push_back(s);
+        }
+    }
+}
+
+void Wavefront::Pool::gather(){
+    active.clear();
+    for (size_t s=0; s<in_flight.size(); ++s){
+        if (in_flight[s]){
+            active.push_back(s);
+        }
+    }
+}
+
+void Wavefront::Pool::flush(){
+    std::lock_guard<std::mutex> lock(wf.mutex);
+    for (auto &splat : splats){
+        wf.pixels[splat.ind].add(splat.rgb);
+        if (wf.aux){
+            wf.aux[splat.ind].add(splat.guide);
+        }
+    }
+    wf.hit_count += splats.size();
+    splats.clear();
+    for (size_t i=0; i<itr_counter.size(); ++i){
+        wf.itr_counter[i] += itr_counter[i];
+        itr_counter[i] = 0;
+    }
+}
@@ -0,0 +1,241 @@
+// Reads a photon path log written by Path_recorder.
+// usage: path_log summary paths.bin
+//        path_log dump    paths.bin [path_amm]
+//        path_log obj     paths.bin out.obj [path_amm]     polylines for a 3d viewer
+// build: g++ -O2 tools/path_log.cpp src/Recorder.cpp src/Sampling.cpp src/Vec_3d.cpp src/Spectrum.cpp -pthread -o path_log
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "../include/Recorder.hpp"
+
+struct Log_vertex{
+    uint8_t kind;
+    size_t body;
+    Vec_3d pos;
+};
+
+struct Log_path{
+    uint64_t frame;
+    uint64_t photon;
+    bool exhausted;
+    std::vector<Log_vertex> vertices;
+};
+
+class Log_reader{
+private:
+    std::vector<uint8_t> data;
+    size_t pos;
+
+    bool get_varint(uint64_t &val){
+        val = 0;
+        for (int shift=0; pos < data.size() && shift < 64; shift += 7){
+            uint8_t byte = data[pos++];
+            val |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)){
+                return true;
+            }
+        }
+        return false;
+    };
+    bool get_string(std::string &str){
+        uint64_t len;
+        if (!get_varint(len) || pos + len > data.size()){
+            return false;
+        }
+        str.assign(data.begin() + pos, data.begin() + pos + len);
+        pos += len;
+        return true;
+    };
+
+public:
+    std::vector<std::string> body_names;
+    std::vector<size_t> body_material;
+    std::vector<std::string> material_names;
+
+    Log_reader(std::string name): pos(0) {
+        std::ifstream in(name, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+
+    bool read_header(){
+        if (data.size() < sizeof(path_log_magic) + 4 || std::memcmp(data.data(), path_log_magic, sizeof(path_log_magic)) != 0){
+            return false;
+        }
+        pos = sizeof(path_log_magic);
+        uint32_t version = 0;
+        for (int i=0; i<4; ++i){
+            version |= uint32_t(data[pos++]) << (8*i);
+        }
+        if (version != path_log_version){
+            return false;
+        }
+
+        uint64_t amm, material;
+        std::string str;
+        if (!get_varint(amm)) {return false;}
+        for (uint64_t i=0; i<amm; ++i){
+            if (!get_string(str) || !get_varint(material)) {return false;}
+            body_names.push_back(str);
+            body_material.push_back(material);
+        }
+        if (!get_varint(amm)) {return false;}
+        for (uint64_t i=0; i<amm; ++i){
+            if (!get_string(str)) {return false;}
+            material_names.push_back(str);
+        }
+        return true;
+    };
+
+    bool next(Log_path &path){
+        uint64_t amm, body, delta;
+        if (!get_varint(path.frame) || !get_varint(path.photon) || pos >= data.size()){
+            return false;
+        }
+        path.exhausted = data[pos++] & 1;
+        if (!get_varint(amm)){
+            return false;
+        }
+        path.vertices.clear();
+        int64_t curr[3] = {0, 0, 0};
+        for (uint64_t i=0; i<amm; ++i){
+            if (pos >= data.size()) {return false;}
+            Log_vertex vertex;
+            vertex.kind = data[pos++];
+            if (!get_varint(body)) {return false;}
+            vertex.body = body;
+            for (int c=0; c<3; ++c){
+                if (!get_varint(delta)) {return false;}
+                curr[c] += unzigzag(delta);
+            }
+            vertex.pos = Vec_3d(curr[0], curr[1], curr[2]) / path_log_scale;
+            path.vertices.push_back(vertex);
+        }
+        return true;
+    };
+
+    std::string body_name(size_t body) const{
+        return body == 0 ? "-" : body_names[body-1];
+    };
+};
+
+static const char *kind_names[] = {"emit", "stray", "screen", "object", "fog"};
+
+static const char *kind_name(uint8_t kind){
+    return kind < 5 ? kind_names[kind] : "?";
+}
+
+int summary(Log_reader &reader){
+    size_t path_amm = 0, vertex_amm = 0, exhausted = 0;
+    std::map<size_t, size_t> length_hist;
+    std::map<std::string, size_t> ends;
+    std::map<uint64_t, size_t> frame_paths;
+    std::vector<size_t> absorbed(reader.body_names.size() + 1), visits(reader.body_names.size() + 1);
+
+    Log_path path;
+    while (reader.next(path)){
+        ++path_amm;
+        ++frame_paths[path.frame];
+        vertex_amm += path.vertices.size();
+        ++length_hist[path.vertices.size() - 1];
+        for (auto &vertex : path.vertices){
+            ++visits[vertex.body];
+        }
+        Log_vertex const &last = path.vertices.back();
+        if (path.exhausted){
+            ++exhausted;
+            ++ends["max_itr"];
+        }else if (last.kind == 1 + int(Photon_event::object)){
+            ++absorbed[last.body];
+            ++ends["absorbed"];
+        }else{
+            ++ends[kind_name(last.kind)];
+        }
+    }
+
+    std::cout << path_amm << " paths, " << vertex_amm << " vertices, " << frame_paths.size() << " frames\n\n";
+    if (frame_paths.size() > 1){
+        std::cout << "paths per frame:\n";
+        for (auto &[frame, amm] : frame_paths){
+            std::cout << "  " << frame << ": " << amm << "\n";
+        }
+        std::cout << "\n";
+    }
+    std::cout << "path end:\n";
+    for (auto &[name, amm] : ends){
+        std::cout << "  " << name << ": " << amm << "\n";
+    }
+    std::cout << "\nevents per path:\n";
+    for (auto &[len, amm] : length_hist){
+        std::cout << "  " << len << ": " << amm << "\n";
+    }
+    std::cout << "\nbody: visits / absorbed\n";
+    for (size_t i=0; i<reader.body_names.size(); ++i){
+        std::cout << "  " << reader.body_names[i] << " (" << reader.material_names[reader.body_material[i]] << "): "
+                  << visits[i+1] << " / " << absorbed[i+1] << "\n";
+    }
+    return 0;
+}
+
+int dump(Log_reader &reader, size_t path_amm){
+    Log_path path;
+    for (size_t i=0; i<path_amm && reader.next(path); ++i){
+        std::cout << "frame " << path.frame << " photon " << path.photon << (path.exhausted ? " (max_itr)" : "") << "\n";
+        for (auto &vertex : path.vertices){
+            std::cout << "  " << kind_name(vertex.kind) << " " << reader.body_name(vertex.body) << " " << vertex.pos << "\n";
+        }
+    }
+    return 0;
+}
+
+int obj(Log_reader &reader, std::string out_name, size_t path_amm){
+    std::ofstream out(out_name);
+    size_t vertex_ind = 1;
+    uint64_t frame = uint64_t(-1);
+    Log_path path;
+    for (size_t i=0; i<path_amm && reader.next(path); ++i){
+        // One group per frame, so a viewer can show the frames apart
+        if (path.frame != frame){
+            frame = path.frame;
+            out << "g frame_" << frame << "\n";
+        }
+        for (auto &vertex : path.vertices){
+            out << "v " << vertex.pos.x << " " << vertex.pos.y << " " << vertex.pos.z << "\n";
+        }
+        out << "l";
+        for (size_t j=0; j<path.vertices.size(); ++j){
+            out << " " << vertex_ind++;
+        }
+        out << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3){
+        std::cerr << "usage: path_log summary|dump|obj paths.bin [...]\n";
+        return 1;
+    }
+    std::string cmd = argv[1];
+    Log_reader reader(argv[2]);
+    if (!reader.read_header()){
+        std::cerr << "not a path log: " << argv[2] << "\n";
+        return 1;
+    }
+
+    if (cmd == "summary"){
+        return summary(reader);
+    }
+    if (cmd == "dump"){
+        return dump(reader, argc > 3 ? std::stoul(argv[3]) : 10);
+    }
+    if (cmd == "obj" && argc > 3){
+        return obj(reader, argv[3], argc > 4 ? std::stoul(argv[4]) : size_t(-1));
+    }
+    std::cerr << "unknown command " << cmd << "\n";
+    return 1;
+}
@@ -0,0 +1,45 @@
+// Reads the live preview of a running render and writes it as a PPM image.
+// usage: preview_snapshot [segment name] [output name] [scale]
+// build: g++ -O2 tools/preview_snapshot.cpp src/Preview.cpp src/Sampling.cpp src/Vec_3d.cpp src/Spectrum.cpp -o preview_snapshot
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "../include/Preview.hpp"
+
+int main(int argc, char **argv)
+{
+    std::string name = argc > 1 ? argv[1] : "/ray_1";
+    std::string out_name = argc > 2 ? argv[2] : "preview";
+    double scale = argc > 3 ? std::stod(argv[3]) : 1.0;
+
+    Preview_reader reader(name);
+    if (!reader.is_open()){
+        std::cerr << "no preview segment " << name << "\n";
+        return 1;
+    }
+
+    size_t width = reader.width(), height = reader.height();
+    std::vector<float> rgb(3 * width * height);
+    uint64_t photon_count = 0, frame = 0, seq = 0;
+    if (!reader.snapshot(rgb.data(), photon_count, frame, seq)){
+        std::cerr << "preview segment " << name << " is stale or torn: its writer stopped mid-update\n";
+        return 1;
+    }
+    std::cout << "frame " << frame << ", " << photon_count << " photons, sequence " << seq << "\n";
+
+    std::ofstream out(out_name + ".ppm");
+    out << "P3" << " " << width << " " << height << " " << "255" << "\n";
+    for (size_t i=0; i<width*height; ++i){
+        for (int c=0; c<3; ++c){
+            double v = rgb[3*i + c] * scale;
+            if (v < 0)   v = 0;
+            if (v > 255) v = 255;
+            out << std::lround(v) << " ";
+        }
+        out << "\n";
+    }
+    out.close();
+    return 0;
+}